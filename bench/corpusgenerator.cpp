@@ -0,0 +1,178 @@
+#include "corpusgenerator.h"
+#include <algorithm>
+#include <cmath>
+
+static const char *const COMMON_WORDS[] = {
+    "src", "main", "test", "util", "core", "app", "lib", "config", "index", "data",
+    "model", "view", "controller", "service", "helper", "manager", "window", "widget", "dialog", "file",
+    "server", "client", "http", "api", "user", "auth", "session", "cache", "store", "event",
+    "handler", "parser", "writer", "reader", "stream", "buffer", "queue", "thread", "pool", "task",
+    "image", "icon", "logo", "theme", "style", "layout", "render", "shader", "mesh", "texture",
+    "network", "socket", "request", "response", "router", "query", "schema", "table", "record", "entry",
+    "search", "match", "filter", "sort", "tree", "node", "graph", "path", "list", "map",
+    "build", "docs", "assets", "vendor", "tools", "scripts", "include", "common", "shared", "internal"
+};
+
+static const char *const SYLLABLES[] = {
+    "ka", "lo", "mi", "ne", "ru", "ta", "vo", "zen", "qui", "bra", "sto", "fle",
+    "dor", "pix", "gal", "tem", "vex", "nor", "sil", "mar", "ul", "ex", "an", "or"
+};
+
+struct WeightedExtension {
+    const char *extension;
+    int weight;
+};
+
+static const WeightedExtension EXTENSIONS[] = {
+    {"cpp", 14}, {"h", 14}, {"js", 10}, {"ts", 9}, {"py", 9}, {"json", 6}, {"md", 5},
+    {"png", 5}, {"txt", 4}, {"go", 4}, {"rs", 3}, {"java", 3}, {"html", 3}, {"css", 3},
+    {"svg", 2}, {"yml", 2}, {"xml", 2}, {"sh", 1}, {"o", 1}, {"", 1}
+};
+
+static const int WORD_COUNT = sizeof(COMMON_WORDS) / sizeof(COMMON_WORDS[0]);
+static const int SYLLABLE_COUNT = sizeof(SYLLABLES) / sizeof(SYLLABLES[0]);
+static const int MAX_DEPTH = 14;
+static const int TYPICAL_DEPTH = 5;
+static const int FILES_PER_DIRECTORY = 10;
+
+CorpusGenerator::CorpusGenerator(quint64 seed)
+    : m_random(seed)
+{
+}
+
+double CorpusGenerator::uniform()
+{
+    return std::uniform_real_distribution<double>(0.0, 1.0)(m_random);
+}
+
+int CorpusGenerator::skewedIndex(int size, double skew)
+{
+    // Low indices are drawn far more often than high ones
+    return qMin(size - 1, int(size * std::pow(uniform(), skew)));
+}
+
+QString CorpusGenerator::word()
+{
+    if (uniform() < 0.8) {
+        return QString::fromLatin1(COMMON_WORDS[skewedIndex(WORD_COUNT, 2.0)]);
+    }
+
+    // Made-up words stand in for the project-specific vocabulary of a real tree
+    QString made;
+    const int syllables = 2 + int(uniform() * 3);
+    for (int i = 0; i < syllables; ++i) {
+        made += QString::fromLatin1(SYLLABLES[int(uniform() * SYLLABLE_COUNT)]);
+    }
+    return made;
+}
+
+QString CorpusGenerator::directoryName()
+{
+    QString name = word();
+    const double style = uniform();
+    if (style < 0.15) {
+        name += '-' + word();
+    } else if (style < 0.25) {
+        name += QString::number(int(uniform() * 10));
+    }
+    return name;
+}
+
+QString CorpusGenerator::fileName()
+{
+    QStringList words;
+    const int wordCount = 1 + skewedIndex(3, 1.5);
+    for (int i = 0; i < wordCount; ++i) {
+        words.append(word());
+    }
+
+    QString stem;
+    const double style = uniform();
+    if (style < 0.3) {
+        // camelCase or PascalCase
+        const bool pascal = uniform() < 0.5;
+        for (int i = 0; i < words.size(); ++i) {
+            QString part = words.at(i);
+            if (i > 0 || pascal) {
+                part[0] = part.at(0).toUpper();
+            }
+            stem += part;
+        }
+    } else if (style < 0.6) {
+        stem = words.join("_");
+    } else if (style < 0.75) {
+        stem = words.join("-");
+    } else {
+        stem = words.join("");
+    }
+
+    if (uniform() < 0.1) {
+        stem += QString::number(int(uniform() * 100));
+    }
+
+    const QString ext = extension();
+    return ext.isEmpty() ? stem : stem + '.' + ext;
+}
+
+QString CorpusGenerator::extension()
+{
+    static int totalWeight = 0;
+    if (totalWeight == 0) {
+        for (const WeightedExtension &entry : EXTENSIONS) {
+            totalWeight += entry.weight;
+        }
+    }
+
+    int pick = int(uniform() * totalWeight);
+    for (const WeightedExtension &entry : EXTENSIONS) {
+        if (pick < entry.weight) {
+            return QString::fromLatin1(entry.extension);
+        }
+        pick -= entry.weight;
+    }
+    return QString();
+}
+
+QStringList CorpusGenerator::generate(int count)
+{
+    const int directoryCount = qMax(1, count / FILES_PER_DIRECTORY);
+
+    // Directory depths cluster around a typical nesting level with a long tail; new
+    // directories favour recently created parents, giving dense subtrees like a real checkout
+    QStringList directories;
+    QVector<QVector<int>> byDepth(MAX_DEPTH + 1);
+    directories.reserve(directoryCount);
+    directories.append(QStringLiteral("/home/dev/projects"));
+    byDepth[0].append(0);
+
+    std::poisson_distribution<int> depthDistribution(TYPICAL_DEPTH - 1);
+    while (directories.size() < directoryCount) {
+        int depth = qMin(1 + depthDistribution(m_random), MAX_DEPTH);
+        while (byDepth.at(depth - 1).isEmpty()) {
+            --depth;
+        }
+
+        const QVector<int> &parents = byDepth.at(depth - 1);
+        const int recent = qMin(parents.size(), 16);
+        const int parent = uniform() < 0.5 ? parents.at(parents.size() - 1 - int(uniform() * recent))
+                                           : parents.at(int(uniform() * parents.size()));
+
+        byDepth[depth].append(directories.size());
+        directories.append(directories.at(parent) + '/' + directoryName());
+    }
+
+    // A few directories hold most of the files
+    QVector<int> popularity(directoryCount);
+    for (int i = 0; i < directoryCount; ++i) {
+        popularity[i] = i;
+    }
+    std::shuffle(popularity.begin(), popularity.end(), m_random);
+
+    QStringList paths;
+    paths.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        const int directory = popularity.at(skewedIndex(directoryCount, 2.0));
+        paths.append(directories.at(directory) + '/' + fileName());
+    }
+    return paths;
+}
@@ -0,0 +1,31 @@
+#ifndef CORPUSGENERATOR_H
+#define CORPUSGENERATOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QtGlobal>
+#include <random>
+
+// Deterministic synthetic path corpora shaped like real project trees. Directory depth,
+// files per directory, name styles and extensions follow skewed distributions, so common
+// words and extensions repeat heavily while rare names keep queries selective.
+class CorpusGenerator
+{
+public:
+    explicit CorpusGenerator(quint64 seed = 1);
+
+    QStringList generate(int count);
+
+private:
+    double uniform();
+    int skewedIndex(int size, double skew);
+    QString word();
+    QString directoryName();
+    QString fileName();
+    QString extension();
+
+    std::mt19937_64 m_random;
+};
+
+#endif // CORPUSGENERATOR_H
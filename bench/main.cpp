@@ -0,0 +1,226 @@
+#include "corpusgenerator.h"
+#include "executor.h"
+#include "fuzzymatcher.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+// Typed searches replayed when no recorded sessions are given
+static const char *const DEFAULT_SESSIONS[] = {
+    "main", "mainwindow", "readme", "config.json", "src/util", "controller", "mw",
+    "netwrok", "search .py", "render !test", "^index", "http_server", "logo .png", "queue handler"
+};
+
+struct RunStats {
+    qint64 buildNsecs;
+    std::vector<qint64> latencies;  // Nanoseconds per keystroke
+    qint64 totalNsecs;
+};
+
+static qint64 peakResidentBytes()
+{
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+#ifdef Q_OS_MACOS
+    return usage.ru_maxrss;
+#else
+    return qint64(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return -1;
+#endif
+}
+
+static QStringList readLines(const QString &fileName, bool *ok)
+{
+    QFile file(fileName);
+    *ok = file.open(QIODevice::ReadOnly | QIODevice::Text);
+    if (!*ok) {
+        return QStringList();
+    }
+
+    QStringList lines;
+    for (const QByteArray &line : file.readAll().split('\n')) {
+        const QString trimmed = QString::fromUtf8(line).trimmed();
+        if (!trimmed.isEmpty()) {
+            lines.append(trimmed);
+        }
+    }
+    return lines;
+}
+
+static double percentile(const std::vector<qint64> &sorted, double fraction)
+{
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    const size_t rank = size_t(std::ceil(fraction * sorted.size()));
+    return sorted[qMin(sorted.size() - 1, rank > 0 ? rank - 1 : 0)] / 1e6;
+}
+
+static RunStats run(const QStringList &corpus, const QStringList &sessions, const QCommandLineParser &parser)
+{
+    FuzzyMatcher matcher;
+    if (parser.value("mode") == "path") {
+        matcher.setScoringMode(FuzzyMatcher::PathScoring);
+    }
+    if (parser.isSet("no-cache")) {
+        matcher.setCacheBudget(0);
+    }
+    if (parser.isSet("no-trigrams")) {
+        matcher.setTrigramIndexEnabled(false);
+    }
+
+    RunStats stats;
+    QElapsedTimer timer;
+    timer.start();
+    matcher.setCollection(corpus);
+    stats.buildNsecs = timer.nsecsElapsed();
+
+    const int maxResults = parser.value("results").toInt();
+    const int repeat = qMax(1, parser.value("repeat").toInt());
+
+    // Every prefix of a session is one keystroke, searched the way the window would
+    stats.totalNsecs = 0;
+    for (int pass = 0; pass < repeat; ++pass) {
+        for (const QString &session : sessions) {
+            for (int length = 1; length <= session.size(); ++length) {
+                timer.restart();
+                matcher.search(session.left(length), maxResults);
+                const qint64 elapsed = timer.nsecsElapsed();
+                stats.latencies.push_back(elapsed);
+                stats.totalNsecs += elapsed;
+            }
+        }
+    }
+
+    std::sort(stats.latencies.begin(), stats.latencies.end());
+    return stats;
+}
+
+static void report(const QString &label, int entries, const RunStats &stats)
+{
+    const double seconds = stats.totalNsecs / 1e9;
+    const qint64 peakRss = peakResidentBytes();
+
+    printf("%-12s %10d %10.1f %8d %8.3f %8.3f %8.3f %10.0f ",
+           qPrintable(label), entries, stats.buildNsecs / 1e6, int(stats.latencies.size()),
+           percentile(stats.latencies, 0.5), percentile(stats.latencies, 0.99),
+           stats.latencies.empty() ? 0.0 : stats.latencies.back() / 1e6,
+           seconds > 0 ? stats.latencies.size() / seconds : 0.0);
+    if (peakRss < 0) {
+        printf("%10s\n", "n/a");
+    } else {
+        printf("%10.1f\n", peakRss / (1024.0 * 1024.0));
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("ez-fuzzy-bench");
+    app.setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures index build time and per-keystroke search latency of the "
+                                     "ez-fuzzy matcher. Peak RSS covers the whole process, so synthetic "
+                                     "sizes run smallest first.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOptions({
+        {{"n", "entries"}, "Comma-separated synthetic corpus sizes.", "counts", "10000,100000,1000000"},
+        {{"c", "corpus"}, "Recorded corpus, one path per line, instead of synthetic ones.", "file"},
+        {{"q", "queries"}, "Recorded sessions, one typed search per line; every prefix is replayed.", "file"},
+        {{"s", "seed"}, "Seed for synthetic corpora.", "seed", "1"},
+        {{"m", "mode"}, "Scoring mode: name or path.", "mode", "name"},
+        {{"r", "results"}, "Results requested per search.", "count", "200"},
+        {"repeat", "Times every session is replayed.", "count", "1"},
+        {{"j", "threads"}, "Worker threads for index builds and searches; all cores by default.", "count"},
+        {"no-cache", "Disable the result cache."},
+        {"no-trigrams", "Disable the trigram index."},
+        {"write-corpus", "Also save each synthetic corpus to <file>.<size>.", "file"},
+    });
+    parser.process(app);
+
+    if (parser.isSet("threads")) {
+        const int threads = parser.value("threads").toInt();
+        if (threads <= 0) {
+            fprintf(stderr, "Invalid thread count: %s\n", qPrintable(parser.value("threads")));
+            return 1;
+        }
+        for (Executor::Lane lane : {Executor::Interactive, Executor::Background}) {
+            Executor::LaneSettings settings = Executor::instance().laneSettings(lane);
+            settings.threads = threads;
+            Executor::instance().setLaneSettings(lane, settings);
+        }
+    }
+    
+    QStringList sessions;
+    if (parser.isSet("queries")) {
+        bool ok;
+        sessions = readLines(parser.value("queries"), &ok);
+        if (!ok) {
+            fprintf(stderr, "Cannot read sessions from %s\n", qPrintable(parser.value("queries")));
+            return 1;
+        }
+    } else {
+        for (const char *session : DEFAULT_SESSIONS) {
+            sessions.append(QString::fromLatin1(session));
+        }
+    }
+
+    printf("%-12s %10s %10s %8s %8s %8s %8s %10s %10s\n",
+           "corpus", "entries", "build ms", "queries", "p50 ms", "p99 ms", "max ms", "queries/s", "peak MB");
+
+    if (parser.isSet("corpus")) {
+        bool ok;
+        const QStringList corpus = readLines(parser.value("corpus"), &ok);
+        if (!ok) {
+            fprintf(stderr, "Cannot read corpus from %s\n", qPrintable(parser.value("corpus")));
+            return 1;
+        }
+        report("recorded", corpus.size(), run(corpus, sessions, parser));
+        return 0;
+    }
+
+    QVector<int> sizes;
+    for (const QString &count : parser.value("entries").split(',', Qt::SkipEmptyParts)) {
+        bool ok;
+        const int size = count.trimmed().toInt(&ok);
+        if (!ok || size <= 0) {
+            fprintf(stderr, "Invalid corpus size: %s\n", qPrintable(count));
+            return 1;
+        }
+        sizes.append(size);
+    }
+    std::sort(sizes.begin(), sizes.end());
+
+    for (int size : sizes) {
+        CorpusGenerator generator(parser.value("seed").toULongLong());
+        const QStringList corpus = generator.generate(size);
+
+        if (parser.isSet("write-corpus")) {
+            QFile file(parser.value("write-corpus") + '.' + QString::number(size));
+            if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+                file.write(corpus.join('\n').toUtf8());
+                file.write("\n");
+            }
+        }
+
+        report("synthetic", size, run(corpus, sessions, parser));
+    }
+
+    return 0;
+}
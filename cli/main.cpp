@@ -0,0 +1,203 @@
+#include "directoryscanner.h"
+#include "executor.h"
+#include "fuzzymatcher.h"
+#include "instrumentation.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+// With --stream, input read so far is indexed and ranked at most this often while the
+// producer (find, say) is still running; otherwise everything is indexed in one go at EOF
+static const int STREAM_INTERVAL_MS = 100;
+
+struct Options {
+    QStringList queries;
+    QString within;
+    int limit;
+    bool stream;
+};
+
+static QVector<QStringList> rankQueries(const FuzzyMatcher &matcher, const Options &options)
+{
+    if (options.within.isEmpty()) {
+        return matcher.searchBatch(options.queries, options.limit);
+    }
+
+    QVector<QStringList> results;
+    for (const QString &query : options.queries) {
+        results.append(matcher.searchWithin(options.within, query, options.limit));
+    }
+    return results;
+}
+
+static bool printResults(const FuzzyMatcher &matcher, const Options &options)
+{
+    const QVector<QStringList> results = rankQueries(matcher, options);
+
+    bool matched = false;
+    for (int q = 0; q < options.queries.size(); ++q) {
+        const QByteArray query = options.queries.at(q).toUtf8();
+        matched = matched || !results.at(q).isEmpty();
+
+        // Several queries share the output, so each line says which one it answers
+        for (const QString &path : results.at(q)) {
+            if (options.queries.size() > 1) {
+                printf("%s\t%s\n", query.constData(), path.toUtf8().constData());
+            } else {
+                printf("%s\n", path.toUtf8().constData());
+            }
+        }
+    }
+    fflush(stdout);
+    return matched;
+}
+
+static void addBatch(FuzzyMatcher &matcher, QStringList &batch, bool &indexed)
+{
+    if (!indexed) {
+        matcher.setCollection(batch);
+        indexed = true;
+    } else {
+        matcher.addPaths(batch);
+    }
+    batch.clear();
+}
+
+static bool filterInput(FuzzyMatcher &matcher, const Options &options, char delimiter)
+{
+    std::ios::sync_with_stdio(false);
+
+    QStringList batch;
+    bool indexed = false;
+    QElapsedTimer sinceOutput;
+    sinceOutput.start();
+
+    std::string line;
+    while (std::getline(std::cin, line, delimiter)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty()) {
+            batch.append(QString::fromUtf8(line.data(), int(line.size())));
+        }
+
+        if (options.stream && sinceOutput.elapsed() >= STREAM_INTERVAL_MS) {
+            // A blank line ends each interim ranking
+            addBatch(matcher, batch, indexed);
+            printResults(matcher, options);
+            printf("\n");
+            sinceOutput.restart();
+        }
+    }
+
+    addBatch(matcher, batch, indexed);
+    return printResults(matcher, options);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("ez-fuzzy-cli");
+    app.setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Ranks paths read from stdin, or found under a directory, against "
+                                     "one or more fuzzy queries. Exits with 1 when nothing matches.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("queries", "Queries to rank the paths against.", "[query...]");
+    parser.addOptions({
+        {{"d", "directory"}, "Scan <dir> instead of reading paths from stdin.", "dir"},
+        {{"f", "queries-file"}, "Read further queries from <file>, one per line.", "file"},
+        {{"n", "limit"}, "Matches printed per query.", "count", "10"},
+        {{"m", "mode"}, "Scoring mode: name or path.", "mode", "name"},
+        {{"w", "within"}, "Only rank paths below <dir>.", "dir"},
+        {{"0", "null"}, "Input paths are separated by NUL characters, as from find -print0."},
+        {{"s", "stream"}, "Print interim rankings, each ended by a blank line, while input arrives."},
+        {{"j", "threads"}, "Worker threads for indexing and for ranking; all cores by default.", "count"},
+        {"stats", "Print per-stage latencies and matcher counters as JSON to stderr on exit."},
+    });
+    parser.process(app);
+
+    Options options;
+    options.queries = parser.positionalArguments();
+    options.stream = parser.isSet("stream");
+    options.within = parser.value("within");
+
+    if (parser.isSet("queries-file")) {
+        QFile file(parser.value("queries-file"));
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            fprintf(stderr, "Cannot read queries from %s\n", qPrintable(parser.value("queries-file")));
+            return 2;
+        }
+        for (const QByteArray &line : file.readAll().split('\n')) {
+            const QString query = QString::fromUtf8(line).trimmed();
+            if (!query.isEmpty()) {
+                options.queries.append(query);
+            }
+        }
+    }
+
+    if (options.queries.isEmpty()) {
+        fprintf(stderr, "No query given\n\n%s", qPrintable(parser.helpText()));
+        return 2;
+    }
+
+    bool ok;
+    options.limit = parser.value("limit").toInt(&ok);
+    if (!ok || options.limit <= 0) {
+        fprintf(stderr, "Invalid limit: %s\n", qPrintable(parser.value("limit")));
+        return 2;
+    }
+
+    if (parser.isSet("threads")) {
+        const int threads = parser.value("threads").toInt(&ok);
+        if (!ok || threads <= 0) {
+            fprintf(stderr, "Invalid thread count: %s\n", qPrintable(parser.value("threads")));
+            return 2;
+        }
+        for (Executor::Lane lane : {Executor::Interactive, Executor::Background}) {
+            Executor::LaneSettings settings = Executor::instance().laneSettings(lane);
+            settings.threads = threads;
+            Executor::instance().setLaneSettings(lane, settings);
+        }
+    }
+    
+    FuzzyMatcher matcher;
+    if (parser.value("mode") == "path") {
+        matcher.setScoringMode(FuzzyMatcher::PathScoring);
+    } else if (parser.value("mode") != "name") {
+        fprintf(stderr, "Unknown scoring mode: %s\n", qPrintable(parser.value("mode")));
+        return 2;
+    }
+
+    bool matched;
+    if (parser.isSet("directory")) {
+        const QString dir = parser.value("directory");
+        if (!QFileInfo(dir).isDir()) {
+            fprintf(stderr, "Not a directory: %s\n", qPrintable(dir));
+            return 2;
+        }
+        // Scanned paths are absolute, so the scope has to be as well
+        if (!options.within.isEmpty()) {
+            options.within = QFileInfo(options.within).absoluteFilePath();
+        }
+        // Every scanned path shares the directory, so it is left out of path alignments
+        matcher.setPathRoot(QFileInfo(dir).absoluteFilePath());
+        DirectoryScanner scanner;
+        matcher.setCollection(scanner.scanDirectory(QFileInfo(dir).absoluteFilePath()));
+        matched = printResults(matcher, options);
+    } else {
+        matched = filterInput(matcher, options, parser.isSet("null") ? '\0' : '\n');
+    }
+
+    if (parser.isSet("stats")) {
+        fputs(Instrumentation::instance().toJson().constData(), stderr);
+    }
+    return matched ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+#include "directoryscanner.h"
+#include "instrumentation.h"
+#include "rangescheduler.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFutureInterface>
+#include <atomic>
+#include <mutex>
+
+QStringList DirectoryScanner::scanDirectory(const QString &path, const QFutureInterfaceBase *control)
+{
+    Instrumentation::Span span(Instrumentation::Scan);
+    QStringList fileList;
+    
+    // Counted per call, so scans that overlap each report their own progress
+    std::atomic<int> filesScanned(0);
+    
+    std::mutex fileListMutex;
+
+    QDir rootDir(path);
+    QStringList topDirs = rootDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    
+    QStringList rootFiles = rootDir.entryList(QDir::Files | QDir::NoDotAndDotDot);
+    {
+        std::lock_guard<std::mutex> lock(fileListMutex);
+        for (const QString &entry : rootFiles) {
+            fileList.append(rootDir.filePath(entry));
+            filesScanned++;
+        }
+        
+        for (const QString &entry : topDirs) {
+            fileList.append(rootDir.filePath(entry));
+            filesScanned++;
+        }
+    }
+    
+    // The root's own entries are listed above; each top-level directory is walked in parallel
+    // on the background lane, with this thread taking a share instead of waiting
+    RangeScheduler::forEach(topDirs.size(), Executor::Background, [&](int d) {
+        if (control && control->isCanceled()) {
+            return;
+        }
+        
+        QString fullSubdirPath = rootDir.filePath(topDirs.at(d));
+        QStringList threadLocalFiles;
+        
+        QDirIterator it(fullSubdirPath, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+        
+        const int batchSize = 1000;
+        int batchCount = 0;
+        
+        // Checked per entry, so a cancelled walk stops without finishing the directory it is in
+        while (it.hasNext() && !(control && control->isCanceled())) {
+            it.next();
+            threadLocalFiles.append(it.filePath());
+            
+            int found = ++filesScanned;
+            if (found % 1000 == 0) {
+                emit scanProgress(found);
+            }
+            
+            if (++batchCount >= batchSize) {
+                std::lock_guard<std::mutex> lock(fileListMutex);
+                fileList.append(threadLocalFiles);
+                threadLocalFiles.clear();
+                batchCount = 0;
+            }
+        }
+        
+        if (!threadLocalFiles.isEmpty()) {
+            std::lock_guard<std::mutex> lock(fileListMutex);
+            fileList.append(threadLocalFiles);
+        }
+    });
+    
+    emit scanProgress(filesScanned);
+    
+    return fileList;
+}
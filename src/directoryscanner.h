@@ -0,0 +1,23 @@
+#ifndef DIRECTORYSCANNER_H
+#define DIRECTORYSCANNER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+class QFutureInterfaceBase;
+
+class DirectoryScanner : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DirectoryScanner(QObject *parent = nullptr) : QObject(parent) {}
+    
+    // Stops walking soon after control is cancelled and returns what it found so far
+    QStringList scanDirectory(const QString &path, const QFutureInterfaceBase *control = nullptr);
+
+signals:
+    void scanProgress(int filesFound);
+};
+
+#endif // DIRECTORYSCANNER_H
@@ -0,0 +1,202 @@
+#include "editdistance.h"
+#include <QVarLengthArray>
+#include <climits>
+
+BitParallelEditDistance::BitParallelEditDistance(const QByteArray &pattern)
+    : m_length(pattern.size())
+    , m_words(qMax(1, (pattern.size() + 63) / 64))
+    , m_lastBit(quint64(1) << ((qMax(1, pattern.size()) - 1) % 64))
+    , m_peq(257 * m_words, 0)
+{
+    for (int i = 0; i < m_length; ++i) {
+        setMatchBit(static_cast<uchar>(pattern.at(i)), i);
+    }
+}
+
+BitParallelEditDistance::BitParallelEditDistance(const QVector<uint> &pattern)
+    : m_length(pattern.size())
+    , m_words(qMax(1, (pattern.size() + 63) / 64))
+    , m_lastBit(quint64(1) << ((qMax(1, pattern.size()) - 1) % 64))
+    , m_peq(257 * m_words, 0)
+{
+    for (int i = 0; i < m_length; ++i) {
+        setMatchBit(pattern.at(i), i);
+    }
+}
+
+void BitParallelEditDistance::setMatchBit(uint c, int position)
+{
+    const quint64 bit = quint64(1) << (position % 64);
+    if (c <= 0xff) {
+        m_peq[c * m_words + position / 64] |= bit;
+        return;
+    }
+
+    int index = m_wideChars.indexOf(c);
+    if (index < 0) {
+        index = m_wideChars.size();
+        m_wideChars.append(c);
+        m_widePeq.resize(m_widePeq.size() + m_words);
+    }
+    m_widePeq[index * m_words + position / 64] |= bit;
+}
+
+const quint64 *BitParallelEditDistance::matchMasks(uint c) const
+{
+    if (c <= 0xff) {
+        return m_peq.constData() + c * m_words;
+    }
+    for (int i = 0; i < m_wideChars.size(); ++i) {
+        if (m_wideChars.at(i) == c) {
+            return m_widePeq.constData() + i * m_words;
+        }
+    }
+    return m_peq.constData() + 256 * m_words;
+}
+
+int BitParallelEditDistance::distance(const char *text, int length, int maxDistance,
+                                      int *lastRowMin) const
+{
+    return dispatchDistance(reinterpret_cast<const uchar *>(text), length, maxDistance,
+                            lastRowMin);
+}
+
+int BitParallelEditDistance::distance(const uint *text, int length, int maxDistance,
+                                      int *lastRowMin) const
+{
+    return dispatchDistance(text, length, maxDistance, lastRowMin);
+}
+
+template <typename Unit>
+int BitParallelEditDistance::dispatchDistance(const Unit *text, int length, int maxDistance,
+                                              int *lastRowMin) const
+{
+    if (m_length == 0 || length == 0) {
+        if (lastRowMin) {
+            *lastRowMin = m_length;
+        }
+        const int trivial = qMax(m_length, length);
+        return trivial <= maxDistance ? trivial : maxDistance + 1;
+    }
+
+    // The distance is at least the length difference
+    if (qAbs(m_length - length) > maxDistance) {
+        return maxDistance + 1;
+    }
+
+    if (m_words == 1) {
+        return singleWordDistance(text, length, maxDistance, lastRowMin);
+    }
+    return blockDistance(text, length, maxDistance, lastRowMin);
+}
+
+template <typename Unit>
+int BitParallelEditDistance::singleWordDistance(const Unit *text, int length, int maxDistance,
+                                                int *lastRowMin) const
+{
+    quint64 vp = ~quint64(0);
+    quint64 vn = 0;
+    int score = m_length;
+    int rowMin = INT_MAX;
+
+    for (int j = 0; j < length; ++j) {
+        const quint64 eq = *matchMasks(text[j]);
+        const quint64 xv = eq | vn;
+        const quint64 xh = (((eq & vp) + vp) ^ vp) | eq;
+        quint64 hp = vn | ~(xh | vp);
+        quint64 hn = vp & xh;
+
+        if (hp & m_lastBit) {
+            ++score;
+        } else if (hn & m_lastBit) {
+            --score;
+        }
+
+        // Row 0 grows by one per column for a global distance
+        hp = (hp << 1) | 1;
+        hn = hn << 1;
+        vp = hn | ~(xv | hp);
+        vn = hp & xv;
+
+        rowMin = qMin(rowMin, score);
+
+        // Each remaining column can lower the score by at most one
+        if (score - (length - j - 1) > maxDistance) {
+            return maxDistance + 1;
+        }
+    }
+
+    if (lastRowMin) {
+        *lastRowMin = rowMin;
+    }
+    return score;
+}
+
+template <typename Unit>
+int BitParallelEditDistance::blockDistance(const Unit *text, int length, int maxDistance,
+                                           int *lastRowMin) const
+{
+    static const quint64 highBit = quint64(1) << 63;
+
+    QVarLengthArray<quint64, 8> vp(m_words);
+    QVarLengthArray<quint64, 8> vn(m_words);
+    for (int w = 0; w < m_words; ++w) {
+        vp[w] = ~quint64(0);
+        vn[w] = 0;
+    }
+
+    int score = m_length;
+    int rowMin = INT_MAX;
+
+    for (int j = 0; j < length; ++j) {
+        const quint64 *peq = matchMasks(text[j]);
+        int hin = 1;  // Row 0 grows by one per column for a global distance
+
+        for (int w = 0; w < m_words; ++w) {
+            quint64 eq = peq[w];
+            const quint64 pv = vp[w];
+            const quint64 mv = vn[w];
+            const quint64 xv = eq | mv;
+
+            if (hin < 0) {
+                eq |= 1;
+            }
+
+            const quint64 xh = (((eq & pv) + pv) ^ pv) | eq;
+            quint64 ph = mv | ~(xh | pv);
+            quint64 mh = pv & xh;
+
+            const quint64 outBit = (w == m_words - 1) ? m_lastBit : highBit;
+            int hout = 0;
+            if (ph & outBit) {
+                hout = 1;
+            } else if (mh & outBit) {
+                hout = -1;
+            }
+
+            ph <<= 1;
+            mh <<= 1;
+            if (hin < 0) {
+                mh |= 1;
+            } else if (hin > 0) {
+                ph |= 1;
+            }
+
+            vp[w] = mh | ~(xv | ph);
+            vn[w] = ph & xv;
+            hin = hout;
+        }
+
+        score += hin;
+        rowMin = qMin(rowMin, score);
+
+        if (score - (length - j - 1) > maxDistance) {
+            return maxDistance + 1;
+        }
+    }
+
+    if (lastRowMin) {
+        *lastRowMin = rowMin;
+    }
+    return score;
+}
@@ -0,0 +1,50 @@
+#ifndef EDITDISTANCE_H
+#define EDITDISTANCE_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QtGlobal>
+
+// Bit-parallel Levenshtein distance (Myers 1999, with Hyyrö's global-distance boundary).
+// The pattern is encoded once into per-byte match masks of 64-bit words; each text byte then
+// advances a whole column of the DP matrix in O(ceil(m / 64)) word operations. Patterns longer
+// than 64 bytes use Myers' block scheme with horizontal deltas carried between words.
+//
+// A pattern given as code points is matched against code point text instead, so non-ASCII
+// characters count as one edit rather than one per UTF-8 byte. Code points above 0xff get
+// their masks from a short list searched per text character.
+class BitParallelEditDistance
+{
+public:
+    explicit BitParallelEditDistance(const QByteArray &pattern);
+    explicit BitParallelEditDistance(const QVector<uint> &pattern);
+
+    int patternLength() const { return m_length; }
+
+    // Returns the distance between the pattern and text, or maxDistance + 1 as soon as it is
+    // known to exceed maxDistance. If lastRowMin is given it receives the smallest distance
+    // between the pattern and any non-empty prefix of text (the pattern length for empty text).
+    int distance(const char *text, int length, int maxDistance, int *lastRowMin = nullptr) const;
+    int distance(const uint *text, int length, int maxDistance, int *lastRowMin = nullptr) const;
+
+private:
+    void setMatchBit(uint c, int position);
+    const quint64 *matchMasks(uchar c) const { return m_peq.constData() + c * m_words; }
+    const quint64 *matchMasks(uint c) const;
+
+    template <typename Unit>
+    int dispatchDistance(const Unit *text, int length, int maxDistance, int *lastRowMin) const;
+    template <typename Unit>
+    int singleWordDistance(const Unit *text, int length, int maxDistance, int *lastRowMin) const;
+    template <typename Unit>
+    int blockDistance(const Unit *text, int length, int maxDistance, int *lastRowMin) const;
+
+    int m_length;
+    int m_words;
+    quint64 m_lastBit;
+    QVector<quint64> m_peq;  // 257 x m_words match masks, indexed [byte * m_words + word]; row 256 is empty
+    QVector<uint> m_wideChars;  // Pattern code points above 0xff
+    QVector<quint64> m_widePeq;  // Their masks, m_words per code point
+};
+
+#endif // EDITDISTANCE_H
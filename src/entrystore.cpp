@@ -0,0 +1,897 @@
+#include "entrystore.h"
+#include "indexsnapshot.h"
+#include "rangescheduler.h"
+#include "searchkey.h"
+#include <QHash>
+#include <QVarLengthArray>
+#include <cstring>
+#include <vector>
+
+EntryStore::EntryStore()
+    : m_pathTableUsed(0)
+    , m_count(0)
+    , m_removedCount(0)
+    , m_directoryCount(0)
+    , m_nameArena(nullptr)
+    , m_lowerArena(nullptr)
+    , m_nameOffsets(nullptr)
+    , m_lowerOffsets(nullptr)
+    , m_directories(nullptr)
+    , m_flags(nullptr)
+    , m_charMasks(nullptr)
+    , m_pathMasks(nullptr)
+    , m_wordInitials(nullptr)
+    , m_directoryNodes(nullptr)
+    , m_directoryArena(nullptr)
+{
+}
+
+EntryStore::EntryStore(const EntryStore &other)
+    : EntryStore()
+{
+    *this = other;
+}
+
+EntryStore &EntryStore::operator=(const EntryStore &other)
+{
+    if (this == &other) {
+        return *this;
+    }
+
+    m_ownedNameArena = other.m_ownedNameArena;
+    m_ownedLowerArena = other.m_ownedLowerArena;
+    m_ownedNameOffsets = other.m_ownedNameOffsets;
+    m_ownedLowerOffsets = other.m_ownedLowerOffsets;
+    m_ownedDirectories = other.m_ownedDirectories;
+    m_ownedFlags = other.m_ownedFlags;
+    m_ownedCharMasks = other.m_ownedCharMasks;
+    m_ownedPathMasks = other.m_ownedPathMasks;
+    m_ownedWordInitials = other.m_ownedWordInitials;
+    m_ownedDirectoryArena = other.m_ownedDirectoryArena;
+    m_ownedDirectoryNodes = other.m_ownedDirectoryNodes;
+    m_snapshot = other.m_snapshot;
+    m_slotIds = other.m_slotIds;
+    m_idSlots = other.m_idSlots;
+    m_pathTable = other.m_pathTable;
+    m_pathTableUsed = other.m_pathTableUsed;
+    m_directoryTable = other.m_directoryTable;
+    m_directoryHashes = other.m_directoryHashes;
+    m_count = other.m_count;
+    m_removedCount = other.m_removedCount;
+    m_directoryCount = other.m_directoryCount;
+
+    // Never the other store's pointers: its owned arrays may be reallocated or freed while
+    // this copy still reads them
+    if (m_snapshot) {
+        m_nameArena = other.m_nameArena;
+        m_lowerArena = other.m_lowerArena;
+        m_nameOffsets = other.m_nameOffsets;
+        m_lowerOffsets = other.m_lowerOffsets;
+        m_directories = other.m_directories;
+        m_flags = other.m_flags;
+        m_charMasks = other.m_charMasks;
+        m_pathMasks = other.m_pathMasks;
+        m_wordInitials = other.m_wordInitials;
+        m_directoryNodes = other.m_directoryNodes;
+        m_directoryArena = other.m_directoryArena;
+    } else if (other.m_nameArena) {
+        bindOwned();
+    } else {
+        m_nameArena = nullptr;
+        m_lowerArena = nullptr;
+        m_nameOffsets = nullptr;
+        m_lowerOffsets = nullptr;
+        m_directories = nullptr;
+        m_flags = nullptr;
+        m_charMasks = nullptr;
+        m_pathMasks = nullptr;
+        m_wordInitials = nullptr;
+        m_directoryNodes = nullptr;
+        m_directoryArena = nullptr;
+    }
+    return *this;
+}
+
+static int characterBit(uchar c)
+{
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a';
+    }
+    if (c >= '0' && c <= '9') {
+        return 26 + (c - '0');
+    }
+    if (c < 0x80) {
+        return 36 + c % 14;
+    }
+    return 50 + c % 14;
+}
+
+struct BitTable {
+    quint64 bits[256];
+    quint64 foldedBits[256];
+    BitTable()
+    {
+        for (int c = 0; c < 256; ++c) {
+            bits[c] = quint64(1) << characterBit(c);
+            foldedBits[c] = quint64(1) << characterBit((c >= 'A' && c <= 'Z') ? c + 32 : c);
+        }
+    }
+};
+
+static inline bool isAsciiAlnum(uchar c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+static const BitTable &bitTable()
+{
+    static const BitTable table;
+    return table;
+}
+
+quint64 EntryStore::characterMaskOf(const char *data, int length)
+{
+    const BitTable &table = bitTable();
+    quint64 mask = 0;
+    for (int i = 0; i < length; ++i) {
+        mask |= table.bits[static_cast<uchar>(data[i])];
+    }
+    return mask;
+}
+
+quint64 EntryStore::foldedCharacterMaskOf(const char *data, int length)
+{
+    const BitTable &table = bitTable();
+    quint64 mask = 0;
+    for (int i = 0; i < length; ++i) {
+        mask |= table.foldedBits[static_cast<uchar>(data[i])];
+    }
+    return mask;
+}
+
+quint64 EntryStore::wordInitialsOf(const char *data, int length)
+{
+    // Words are runs of [a-zA-Z0-9]; the count saturates once every initial byte is used
+    quint64 initials = 0;
+    int words = 0;
+    for (int i = 0; i < length && words < MAX_WORD_INITIALS; ++i) {
+        const uchar c = data[i];
+        if (isAsciiAlnum(c) && (i == 0 || !isAsciiAlnum(data[i - 1]))) {
+            initials |= quint64(c) << (words * 8);
+            ++words;
+        }
+    }
+    return initials | quint64(words) << 56;
+}
+
+int EntryStore::characterCount(const char *data, int length)
+{
+    int count = 0;
+    for (int i = 0; i < length; ++i) {
+        count += (static_cast<uchar>(data[i]) & 0xc0) != 0x80;
+    }
+    return count;
+}
+
+// Encodes one path into the arenas' formats; shared by the bulk loader and append()
+struct EncodedEntry {
+    QByteArray pathUtf8;
+    QByteArray lowerUtf8;
+    quint32 nameOffset;
+    quint8 flags;
+    quint64 charMask;
+    quint64 pathMask;
+    quint64 wordInitials;
+};
+
+static EncodedEntry encodeEntry(const QString &path)
+{
+    EncodedEntry entry;
+    entry.pathUtf8 = path.toUtf8();
+    entry.lowerUtf8 = SearchKey::foldToUtf8(path, path.lastIndexOf('/') + 1);
+    entry.nameOffset = entry.pathUtf8.lastIndexOf('/') + 1;
+
+    entry.flags = EntryStore::AsciiFlag;
+    for (char c : entry.pathUtf8) {
+        if (static_cast<uchar>(c) >= 0x80) {
+            entry.flags &= ~EntryStore::AsciiFlag;
+            break;
+        }
+    }
+    entry.charMask = EntryStore::characterMaskOf(entry.lowerUtf8.constData(),
+                                                 entry.lowerUtf8.size());
+
+    // ASCII paths fold byte by byte; others get their SearchKey so that an accented or uppercase
+    // non-ASCII letter still passes the filter for the key a query spells it as
+    const QByteArray foldedPath =
+        (entry.flags & EntryStore::AsciiFlag) ? entry.pathUtf8 : SearchKey::foldToUtf8(path);
+    entry.pathMask = EntryStore::foldedCharacterMaskOf(foldedPath.constData(),
+                                                       foldedPath.size());
+    entry.wordInitials = EntryStore::wordInitialsOf(entry.lowerUtf8.constData(),
+                                                    entry.lowerUtf8.size());
+    return entry;
+}
+
+// One slice of the bulk load, encoded into chunk-local arenas by a single worker. The whole
+// paths are only kept until their directories have been interned.
+struct BuildChunk {
+    int begin;
+    int end;
+    QByteArray pathArena;
+    QByteArray lowerArena;
+    QVector<quint32> pathOffsets;
+    QVector<quint32> nameOffsets;
+    QVector<quint32> lowerOffsets;
+    QVector<quint8> flags;
+    QVector<quint64> charMasks;
+    QVector<quint64> pathMasks;
+    QVector<quint64> wordInitials;
+    quint32 nameSize;
+    quint32 nameBase;
+    quint32 lowerBase;
+};
+
+static const int BUILD_CHUNK_SIZE = 8192;
+static const quint32 NO_DIRECTORY_ID = quint32(EntryStore::NO_DIRECTORY);
+
+void EntryStore::build(const QStringList &paths)
+{
+    clear();
+    detach();
+
+    const int count = paths.size();
+    QVector<BuildChunk> chunks((count + BUILD_CHUNK_SIZE - 1) / BUILD_CHUNK_SIZE);
+    for (int c = 0; c < chunks.size(); ++c) {
+        chunks[c].begin = c * BUILD_CHUNK_SIZE;
+        chunks[c].end = qMin(count, chunks[c].begin + BUILD_CHUNK_SIZE);
+    }
+
+    // Encode every chunk independently, then lay the chunks out back to back
+    BuildChunk *chunkData = chunks.data();
+    RangeScheduler::forEach(chunks.size(), Executor::Background, [&paths, chunkData](int c) {
+        BuildChunk &chunk = chunkData[c];
+        const int chunkCount = chunk.end - chunk.begin;
+        chunk.pathOffsets.reserve(chunkCount + 1);
+        chunk.nameOffsets.reserve(chunkCount);
+        chunk.lowerOffsets.reserve(chunkCount);
+        chunk.flags.reserve(chunkCount);
+        chunk.charMasks.reserve(chunkCount);
+        chunk.pathMasks.reserve(chunkCount);
+        chunk.wordInitials.reserve(chunkCount);
+        chunk.nameSize = 0;
+
+        for (int i = chunk.begin; i < chunk.end; ++i) {
+            const EncodedEntry entry = encodeEntry(paths.at(i));
+            chunk.pathOffsets.append(chunk.pathArena.size());
+            chunk.nameOffsets.append(entry.nameOffset);
+            chunk.lowerOffsets.append(chunk.lowerArena.size());
+            chunk.flags.append(entry.flags);
+            chunk.charMasks.append(entry.charMask);
+            chunk.pathMasks.append(entry.pathMask);
+            chunk.wordInitials.append(entry.wordInitials);
+            chunk.pathArena.append(entry.pathUtf8);
+            chunk.lowerArena.append(entry.lowerUtf8);
+            chunk.nameSize += entry.pathUtf8.size() - entry.nameOffset;
+        }
+        chunk.pathOffsets.append(chunk.pathArena.size());
+    });
+
+    quint32 nameSize = 0;
+    quint32 lowerSize = 0;
+    for (BuildChunk &chunk : chunks) {
+        chunk.nameBase = nameSize;
+        chunk.lowerBase = lowerSize;
+        nameSize += chunk.nameSize;
+        lowerSize += chunk.lowerArena.size();
+    }
+
+    m_ownedNameArena.resize(nameSize);
+    m_ownedLowerArena.resize(lowerSize);
+    m_ownedNameOffsets.resize(count + 1);
+    m_ownedLowerOffsets.resize(count + 1);
+    m_ownedDirectories.resize(count);
+    m_ownedFlags.resize(count);
+    m_ownedCharMasks.resize(count);
+    m_ownedPathMasks.resize(count);
+    m_ownedWordInitials.resize(count);
+
+    // Directories get their ids in input order, one at a time; scanners list a directory's
+    // files together, so most entries reuse the previous entry's directory
+    quint32 *directories = m_ownedDirectories.data();
+    const char *previousDirectory = nullptr;
+    int previousLength = -1;
+    quint32 previousId = NO_DIRECTORY_ID;
+    for (const BuildChunk &chunk : chunks) {
+        for (int k = 0; k < chunk.end - chunk.begin; ++k) {
+            const char *path = chunk.pathArena.constData() + chunk.pathOffsets.at(k);
+            const int length = int(chunk.nameOffsets.at(k)) - 1;
+            if (length < 0) {
+                directories[chunk.begin + k] = NO_DIRECTORY_ID;
+                continue;
+            }
+            if (length != previousLength || memcmp(path, previousDirectory, length) != 0) {
+                previousId = quint32(internDirectory(path, length));
+                previousDirectory = path;
+                previousLength = length;
+            }
+            directories[chunk.begin + k] = previousId;
+        }
+    }
+
+    char *nameArena = m_ownedNameArena.data();
+    char *lowerArena = m_ownedLowerArena.data();
+    quint32 *nameOffsets = m_ownedNameOffsets.data();
+    quint32 *lowerOffsets = m_ownedLowerOffsets.data();
+    quint8 *flags = m_ownedFlags.data();
+    quint64 *charMasks = m_ownedCharMasks.data();
+    quint64 *pathMasks = m_ownedPathMasks.data();
+    quint64 *wordInitials = m_ownedWordInitials.data();
+
+    RangeScheduler::forEach(chunks.size(), Executor::Background, [=](int c) {
+        const BuildChunk &chunk = chunkData[c];
+        const int chunkCount = chunk.end - chunk.begin;
+        memcpy(lowerArena + chunk.lowerBase, chunk.lowerArena.constData(),
+               chunk.lowerArena.size());
+        memcpy(flags + chunk.begin, chunk.flags.constData(), chunkCount);
+        memcpy(charMasks + chunk.begin, chunk.charMasks.constData(),
+               chunkCount * sizeof(quint64));
+        memcpy(pathMasks + chunk.begin, chunk.pathMasks.constData(),
+               chunkCount * sizeof(quint64));
+        memcpy(wordInitials + chunk.begin, chunk.wordInitials.constData(),
+               chunkCount * sizeof(quint64));
+
+        quint32 nameOffset = chunk.nameBase;
+        for (int k = 0; k < chunkCount; ++k) {
+            const quint32 nameBegin = chunk.pathOffsets.at(k) + chunk.nameOffsets.at(k);
+            const quint32 length = chunk.pathOffsets.at(k + 1) - nameBegin;
+            memcpy(nameArena + nameOffset, chunk.pathArena.constData() + nameBegin, length);
+            nameOffsets[chunk.begin + k] = nameOffset;
+            nameOffset += length;
+            lowerOffsets[chunk.begin + k] = chunk.lowerBase + chunk.lowerOffsets.at(k);
+        }
+    });
+    nameOffsets[count] = nameSize;
+    lowerOffsets[count] = lowerSize;
+
+    m_count = count;
+    bindOwned();
+}
+
+void EntryStore::adopt(const QSharedPointer<const IndexSnapshot> &snapshot)
+{
+    clear();
+
+    if (!snapshot || !snapshot->isOpen()) {
+        return;
+    }
+
+    // The arrays stay in the mapped file; the shared pointer keeps the mapping alive
+    m_snapshot = snapshot;
+    m_count = snapshot->size();
+    m_directoryCount = snapshot->directoryCount();
+    m_nameArena = snapshot->nameArena();
+    m_lowerArena = snapshot->lowerArena();
+    m_nameOffsets = snapshot->nameOffsets();
+    m_lowerOffsets = snapshot->lowerOffsets();
+    m_directories = snapshot->directoryData();
+    m_flags = snapshot->flagData();
+    m_charMasks = snapshot->characterMasks();
+    m_pathMasks = snapshot->pathMasks();
+    m_wordInitials = snapshot->wordInitials();
+    m_directoryNodes = snapshot->directoryNodes();
+    m_directoryArena = snapshot->directoryArena();
+}
+
+void EntryStore::clear()
+{
+    m_ownedNameArena.clear();
+    m_ownedLowerArena.clear();
+    m_ownedNameOffsets.clear();
+    m_ownedLowerOffsets.clear();
+    m_ownedDirectories.clear();
+    m_ownedFlags.clear();
+    m_ownedCharMasks.clear();
+    m_ownedPathMasks.clear();
+    m_ownedWordInitials.clear();
+    m_ownedDirectoryArena.clear();
+    m_ownedDirectoryNodes.clear();
+    m_snapshot.reset();
+    m_slotIds.clear();
+    m_idSlots.clear();
+    m_pathTable.clear();
+    m_pathTableUsed = 0;
+    m_directoryTable.clear();
+    m_directoryHashes.clear();
+
+    m_count = 0;
+    m_removedCount = 0;
+    m_directoryCount = 0;
+    m_nameArena = nullptr;
+    m_lowerArena = nullptr;
+    m_nameOffsets = nullptr;
+    m_lowerOffsets = nullptr;
+    m_directories = nullptr;
+    m_flags = nullptr;
+    m_charMasks = nullptr;
+    m_pathMasks = nullptr;
+    m_wordInitials = nullptr;
+    m_directoryNodes = nullptr;
+    m_directoryArena = nullptr;
+}
+
+void EntryStore::copyPath(int index, char *buffer) const
+{
+    const int length = pathLength(index);
+    const int nameBytes = nameLength(index);
+    memcpy(buffer + length - nameBytes, name(index), nameBytes);
+
+    const int directory = directoryOf(index);
+    if (directory != NO_DIRECTORY) {
+        const DirectoryNode &node = m_directoryNodes[directory];
+        memcpy(buffer, m_directoryArena + node.pathOffset, node.pathLength);
+        buffer[node.pathLength] = '/';
+    }
+}
+
+void EntryStore::copyFoldedPath(int index, char *buffer) const
+{
+    const int length = foldedPathLength(index);
+    const int nameBytes = lowerNameLength(index);
+    memcpy(buffer + length - nameBytes, lowerName(index), nameBytes);
+
+    const int directory = directoryOf(index);
+    if (directory != NO_DIRECTORY) {
+        const DirectoryNode &node = m_directoryNodes[directory];
+        if (node.foldedLength) {
+            memcpy(buffer, m_directoryArena + node.pathOffset + node.pathLength, node.foldedLength);
+        } else {
+            memcpy(buffer, m_directoryArena + node.pathOffset, node.pathLength);
+        }
+        buffer[length - nameBytes - 1] = '/';
+    }
+}
+
+QString EntryStore::path(int index) const
+{
+    QVarLengthArray<char, 256> buffer(pathLength(index));
+    copyPath(index, buffer.data());
+    return QString::fromUtf8(buffer.constData(), buffer.size());
+}
+
+QString EntryStore::fileName(int index) const
+{
+    return QString::fromUtf8(name(index), nameLength(index));
+}
+
+int EntryStore::directoryArenaSize() const
+{
+    // Paths are appended in id order, so the last directory's path and key end the arena
+    if (m_directoryCount == 0) {
+        return 0;
+    }
+    const DirectoryNode &last = m_directoryNodes[m_directoryCount - 1];
+    return last.pathOffset + last.pathLength + last.foldedLength;
+}
+
+QString EntryStore::directoryPath(int directory) const
+{
+    const DirectoryNode &node = m_directoryNodes[directory];
+    return QString::fromUtf8(m_directoryArena + node.pathOffset, node.pathLength);
+}
+
+void EntryStore::bindOwned()
+{
+    m_nameArena = m_ownedNameArena.constData();
+    m_lowerArena = m_ownedLowerArena.constData();
+    m_nameOffsets = m_ownedNameOffsets.constData();
+    m_lowerOffsets = m_ownedLowerOffsets.constData();
+    m_directories = m_ownedDirectories.constData();
+    m_flags = m_ownedFlags.constData();
+    m_charMasks = m_ownedCharMasks.constData();
+    m_pathMasks = m_ownedPathMasks.constData();
+    m_wordInitials = m_ownedWordInitials.constData();
+    m_directoryNodes = m_ownedDirectoryNodes.constData();
+    m_directoryArena = m_ownedDirectoryArena.constData();
+}
+
+template <typename T>
+static QVector<T> copySection(const T *data, int count)
+{
+    QVector<T> section(count);
+    memcpy(section.data(), data, count * sizeof(T));
+    return section;
+}
+
+void EntryStore::detach()
+{
+    if (m_snapshot) {
+        const int count = m_count;
+        m_ownedNameArena = QByteArray(m_nameArena, m_nameOffsets[count]);
+        m_ownedLowerArena = QByteArray(m_lowerArena, m_lowerOffsets[count]);
+        m_ownedNameOffsets = copySection(m_nameOffsets, count + 1);
+        m_ownedLowerOffsets = copySection(m_lowerOffsets, count + 1);
+        m_ownedDirectories = copySection(m_directories, count);
+        m_ownedFlags = copySection(m_flags, count);
+        m_ownedCharMasks = copySection(m_charMasks, count);
+        m_ownedPathMasks = copySection(m_pathMasks, count);
+        m_ownedWordInitials = copySection(m_wordInitials, count);
+        m_ownedDirectoryNodes = copySection(m_directoryNodes, m_directoryCount);
+        m_ownedDirectoryArena = QByteArray(m_directoryArena, directoryArenaSize());
+        m_snapshot.reset();
+    } else if (m_ownedNameOffsets.isEmpty()) {
+        m_ownedNameOffsets.append(0);
+        m_ownedLowerOffsets.append(0);
+    }
+    bindOwned();
+}
+
+void EntryStore::ensureIdTables()
+{
+    if (!m_slotIds.isEmpty() || m_count == 0) {
+        return;
+    }
+    m_slotIds.resize(m_count);
+    for (int i = 0; i < m_count; ++i) {
+        m_slotIds[i] = i;
+    }
+    m_idSlots = m_slotIds;
+}
+
+int EntryStore::slotOfId(int id) const
+{
+    if (m_idSlots.isEmpty()) {
+        return id >= 0 && id < m_count ? id : -1;
+    }
+    return id >= 0 && id < m_idSlots.size() ? m_idSlots.at(id) : -1;
+}
+
+int EntryStore::append(const QString &path, int id)
+{
+    detach();
+    ensureIdTables();
+
+    const EncodedEntry entry = encodeEntry(path);
+    const int directory = entry.nameOffset > 0
+                              ? internDirectory(entry.pathUtf8.constData(), entry.nameOffset - 1)
+                              : NO_DIRECTORY;
+    m_ownedNameArena.append(entry.pathUtf8.constData() + entry.nameOffset,
+                            entry.pathUtf8.size() - entry.nameOffset);
+    m_ownedLowerArena.append(entry.lowerUtf8);
+    m_ownedNameOffsets.append(m_ownedNameArena.size());
+    m_ownedLowerOffsets.append(m_ownedLowerArena.size());
+    m_ownedDirectories.append(quint32(directory));
+    m_ownedFlags.append(entry.flags);
+    m_ownedCharMasks.append(entry.charMask);
+    m_ownedPathMasks.append(entry.pathMask);
+    m_ownedWordInitials.append(entry.wordInitials);
+
+    if (id < 0) {
+        id = m_idSlots.size();
+    }
+    while (m_idSlots.size() <= id) {
+        m_idSlots.append(-1);
+    }
+
+    const int slot = m_count++;
+    m_slotIds.append(id);
+    m_idSlots[id] = slot;
+    bindOwned();
+
+    if (!m_pathTable.isEmpty()) {
+        insertIntoPathTable(slot);
+    }
+    return slot;
+}
+
+bool EntryStore::remove(int slot)
+{
+    if (slot < 0 || slot >= m_count || isRemoved(slot)) {
+        return false;
+    }
+
+    detach();
+    ensureIdTables();
+
+    // The slot keeps its bytes until compact(); only the flag and the id mapping change
+    m_ownedFlags[slot] |= RemovedFlag;
+    m_idSlots[m_slotIds.at(slot)] = -1;
+    ++m_removedCount;
+    bindOwned();
+    return true;
+}
+
+static uint pathHash(const char *data, int length)
+{
+    return qHashBits(data, length);
+}
+
+bool EntryStore::directoryEquals(int directory, const char *data, int length) const
+{
+    const DirectoryNode &node = m_directoryNodes[directory];
+    return node.pathLength == quint32(length) &&
+           memcmp(m_directoryArena + node.pathOffset, data, length) == 0;
+}
+
+bool EntryStore::pathEquals(int slot, const QByteArray &pathUtf8) const
+{
+    const int length = pathUtf8.size();
+    const int nameBytes = nameLength(slot);
+    if (pathLength(slot) != length ||
+        memcmp(pathUtf8.constData() + length - nameBytes, name(slot), nameBytes) != 0) {
+        return false;
+    }
+
+    const int directory = directoryOf(slot);
+    return directory == NO_DIRECTORY ||
+           (pathUtf8.at(length - nameBytes - 1) == '/' &&
+            directoryEquals(directory, pathUtf8.constData(), length - nameBytes - 1));
+}
+
+void EntryStore::ensurePathTable()
+{
+    const int wanted = (m_count - m_removedCount + 1) * 2;
+    if (!m_pathTable.isEmpty() && (m_pathTableUsed + 1) * 2 <= m_pathTable.size()) {
+        return;
+    }
+
+    int capacity = 16;
+    while (capacity < wanted) {
+        capacity *= 2;
+    }
+    m_pathTable.fill(-1, capacity);
+    m_pathTableUsed = 0;
+    for (int slot = 0; slot < m_count; ++slot) {
+        if (!isRemoved(slot)) {
+            insertIntoPathTable(slot);
+        }
+    }
+}
+
+void EntryStore::insertIntoPathTable(int slot)
+{
+    // Removed slots stay in the table until it is rebuilt, so keep the load factor at 1/2
+    if ((m_pathTableUsed + 1) * 2 > m_pathTable.size()) {
+        ensurePathTable();
+        return;
+    }
+
+    QVarLengthArray<char, 256> path(pathLength(slot));
+    copyPath(slot, path.data());
+
+    const int mask = m_pathTable.size() - 1;
+    int bucket = pathHash(path.constData(), path.size()) & mask;
+    while (m_pathTable.at(bucket) >= 0) {
+        bucket = (bucket + 1) & mask;
+    }
+    m_pathTable[bucket] = slot;
+    ++m_pathTableUsed;
+}
+
+int EntryStore::slotOf(const QString &path)
+{
+    if (m_count == m_removedCount) {
+        return -1;
+    }
+    ensurePathTable();
+
+    const QByteArray pathUtf8 = path.toUtf8();
+    const int mask = m_pathTable.size() - 1;
+    int bucket = pathHash(pathUtf8.constData(), pathUtf8.size()) & mask;
+    for (int slot = m_pathTable.at(bucket); slot >= 0; slot = m_pathTable.at(bucket)) {
+        if (!isRemoved(slot) && pathEquals(slot, pathUtf8)) {
+            return slot;
+        }
+        bucket = (bucket + 1) & mask;
+    }
+    return -1;
+}
+
+void EntryStore::ensureDirectoryTable()
+{
+    if (m_directoryHashes.size() < m_directoryCount) {
+        // Borrowed directories have no stored hashes yet
+        m_directoryHashes.resize(m_directoryCount);
+        for (int d = 0; d < m_directoryCount; ++d) {
+            const DirectoryNode &node = m_directoryNodes[d];
+            m_directoryHashes[d] = pathHash(m_directoryArena + node.pathOffset, node.pathLength);
+        }
+        m_directoryTable.clear();
+    }
+
+    const int wanted = (m_directoryCount + 1) * 2;
+    if (m_directoryTable.size() >= wanted) {
+        return;
+    }
+
+    int capacity = 16;
+    while (capacity < wanted * 2) {
+        capacity *= 2;
+    }
+    m_directoryTable.fill(-1, capacity);
+    for (int d = 0; d < m_directoryCount; ++d) {
+        insertIntoDirectoryTable(d);
+    }
+}
+
+void EntryStore::insertIntoDirectoryTable(int directory)
+{
+    const int mask = m_directoryTable.size() - 1;
+    int bucket = m_directoryHashes.at(directory) & mask;
+    while (m_directoryTable.at(bucket) >= 0) {
+        bucket = (bucket + 1) & mask;
+    }
+    m_directoryTable[bucket] = directory;
+}
+
+int EntryStore::lookupDirectory(const char *data, int length, uint hash) const
+{
+    const int mask = m_directoryTable.size() - 1;
+    int bucket = hash & mask;
+    for (int d = m_directoryTable.at(bucket); d >= 0; d = m_directoryTable.at(bucket)) {
+        if (m_directoryHashes.at(d) == hash && directoryEquals(d, data, length)) {
+            return d;
+        }
+        bucket = (bucket + 1) & mask;
+    }
+    return NO_DIRECTORY;
+}
+
+int EntryStore::internDirectory(const char *data, int length)
+{
+    ensureDirectoryTable();
+
+    const uint hash = pathHash(data, length);
+    const int existing = lookupDirectory(data, length, hash);
+    if (existing != NO_DIRECTORY) {
+        return existing;
+    }
+
+    // Parents are interned first, so every directory comes after its parent
+    int slash = length - 1;
+    while (slash >= 0 && data[slash] != '/') {
+        --slash;
+    }
+    const int parent = slash >= 0 ? internDirectory(data, slash) : NO_DIRECTORY;
+
+    DirectoryNode node;
+    node.parent = quint32(parent);
+    node.pathOffset = m_ownedDirectoryArena.size();
+    node.pathLength = length;
+    node.nameLength = length - slash - 1;
+    node.foldedLength = 0;
+    m_ownedDirectoryArena.append(data, length);
+    for (int i = 0; i < length; ++i) {
+        if (static_cast<uchar>(data[i]) >= 0x80) {
+            const QByteArray folded = SearchKey::foldToUtf8(QString::fromUtf8(data, length));
+            node.foldedLength = folded.size();
+            m_ownedDirectoryArena.append(folded);
+            break;
+        }
+    }
+    m_ownedDirectoryNodes.append(node);
+    m_directoryHashes.append(hash);
+
+    const int directory = m_directoryCount++;
+    bindOwned();
+
+    if (m_directoryTable.size() < (m_directoryCount + 1) * 2) {
+        ensureDirectoryTable();  // The rebuilt table already holds the new directory
+    } else {
+        insertIntoDirectoryTable(directory);
+    }
+    return directory;
+}
+
+int EntryStore::findDirectory(const QString &path) const
+{
+    QByteArray pathUtf8 = path.toUtf8();
+    if (pathUtf8.endsWith('/')) {
+        pathUtf8.chop(1);
+    }
+
+    // Searches never build the table, so before the first insertion every directory is checked
+    if (m_directoryHashes.size() == m_directoryCount && !m_directoryTable.isEmpty()) {
+        return lookupDirectory(pathUtf8.constData(), pathUtf8.size(),
+                               pathHash(pathUtf8.constData(), pathUtf8.size()));
+    }
+    for (int d = 0; d < m_directoryCount; ++d) {
+        if (directoryEquals(d, pathUtf8.constData(), pathUtf8.size())) {
+            return d;
+        }
+    }
+    return NO_DIRECTORY;
+}
+
+QVector<int> EntryStore::entriesUnder(int directory) const
+{
+    QVector<int> entries;
+    if (directory < 0 || directory >= m_directoryCount) {
+        return entries;
+    }
+
+    // Descendants always have higher ids than the directory, and each follows its parent
+    std::vector<bool> inside(m_directoryCount - directory, false);
+    inside[0] = true;
+    for (int d = directory + 1; d < m_directoryCount; ++d) {
+        const quint32 parent = m_directoryNodes[d].parent;
+        inside[d - directory] = parent != NO_DIRECTORY_ID && int(parent) >= directory &&
+                                inside[parent - directory];
+    }
+
+    for (int slot = 0; slot < m_count; ++slot) {
+        const quint32 d = m_directories[slot];
+        if (d != NO_DIRECTORY_ID && int(d) >= directory && inside[d - directory] &&
+            !isRemoved(slot)) {
+            entries.append(slot);
+        }
+    }
+    return entries;
+}
+
+void EntryStore::compact()
+{
+    if (m_removedCount == 0) {
+        return;
+    }
+
+    // Directories are shared and small, so they stay even when their last entry is gone
+    const int liveEntries = m_count - m_removedCount;
+    QByteArray nameArena;
+    QByteArray lowerArena;
+    QVector<quint32> nameOffsets;
+    QVector<quint32> lowerOffsets;
+    QVector<quint32> directories;
+    QVector<quint8> flags;
+    QVector<quint64> charMasks;
+    QVector<quint64> pathMasks;
+    QVector<quint64> wordInitials;
+    QVector<int> slotIds;
+    nameArena.reserve(m_nameOffsets[m_count]);
+    lowerArena.reserve(m_lowerOffsets[m_count]);
+    nameOffsets.reserve(liveEntries + 1);
+    lowerOffsets.reserve(liveEntries + 1);
+    directories.reserve(liveEntries);
+    flags.reserve(liveEntries);
+    charMasks.reserve(liveEntries);
+    pathMasks.reserve(liveEntries);
+    wordInitials.reserve(liveEntries);
+    slotIds.reserve(liveEntries);
+
+    for (int slot = 0; slot < m_count; ++slot) {
+        if (isRemoved(slot)) {
+            continue;
+        }
+        nameOffsets.append(nameArena.size());
+        lowerOffsets.append(lowerArena.size());
+        directories.append(m_directories[slot]);
+        flags.append(m_flags[slot]);
+        charMasks.append(m_charMasks[slot]);
+        pathMasks.append(m_pathMasks[slot]);
+        wordInitials.append(m_wordInitials[slot]);
+        nameArena.append(name(slot), nameLength(slot));
+        lowerArena.append(lowerName(slot), lowerNameLength(slot));
+
+        const int id = m_slotIds.at(slot);
+        m_idSlots[id] = slotIds.size();
+        slotIds.append(id);
+    }
+    nameOffsets.append(nameArena.size());
+    lowerOffsets.append(lowerArena.size());
+
+    m_ownedNameArena = nameArena;
+    m_ownedLowerArena = lowerArena;
+    m_ownedNameOffsets = nameOffsets;
+    m_ownedLowerOffsets = lowerOffsets;
+    m_ownedDirectories = directories;
+    m_ownedFlags = flags;
+    m_ownedCharMasks = charMasks;
+    m_ownedPathMasks = pathMasks;
+    m_ownedWordInitials = wordInitials;
+    m_slotIds = slotIds;
+    m_pathTable.clear();
+    m_pathTableUsed = 0;
+
+    m_count = liveEntries;
+    m_removedCount = 0;
+    bindOwned();
+}
@@ -0,0 +1,211 @@
+#ifndef ENTRYSTORE_H
+#define ENTRYSTORE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+#include <QSharedPointer>
+#include <QtGlobal>
+
+class IndexSnapshot;
+
+// Structure-of-arrays storage for the matcher's entries. File names, their search keys
+// (lowercased and accent-stripped, see SearchKey; the "lower" arrays) and directory paths
+// live in packed UTF-8 arenas addressed by offset arrays, so the scorer
+// walks linear memory instead of chasing per-entry QString allocations. A 64-bit
+// character-presence mask per entry lets searches discard names that lack a query character
+// without scoring them. The arrays either belong to the store or are borrowed from a
+// memory-mapped IndexSnapshot with the same layout; the first modification copies borrowed
+// arrays into the store.
+//
+// Paths are not stored whole. Each directory is a node holding its parent's id and its path,
+// and each entry holds its directory's id and its file name, so a directory prefix is kept
+// once however many entries share it. Full paths are put back together on demand, which only
+// takes two copies. A directory is always added after its parent, which makes a subtree one
+// forward pass over the nodes.
+//
+// Entries are addressed by slot, their position in the arrays. Removing an entry only marks
+// its slot with RemovedFlag, so slots stay valid until compact() squeezes the tombstones out.
+// Every entry also has an id that stays the same across compaction.
+class EntryStore
+{
+public:
+    enum EntryFlag {
+        AsciiFlag = 0x01,
+        RemovedFlag = 0x02
+    };
+
+    EntryStore();
+    // A copy shares the original's arrays until either side modifies them: owned arrays are
+    // implicitly shared and borrowed ones stay in the same snapshot. Either way the copy's
+    // pointers are bound to arrays the copy itself keeps alive.
+    EntryStore(const EntryStore &other);
+    EntryStore &operator=(const EntryStore &other);
+
+    // Bits 0-25 a-z, 26-35 0-9, 36-49 other ASCII, 50-63 non-ASCII bytes
+    static quint64 characterMaskOf(const char *data, int length);
+    // Same bits with ASCII letters folded to lowercase first, used for whole ASCII paths
+    static quint64 foldedCharacterMaskOf(const char *data, int length);
+
+    // First letters of the leading words of a lowercased name, one per byte from the lowest,
+    // with the number of letters stored (at most MAX_WORD_INITIALS) in the top byte
+    static const int MAX_WORD_INITIALS = 7;
+    static quint64 wordInitialsOf(const char *data, int length);
+
+    // Number of code points in valid UTF-8
+    static int characterCount(const char *data, int length);
+
+    // Directory id of entries without a '/', and parent id of top-level directories
+    static const int NO_DIRECTORY = -1;
+
+    // A directory's parent id and its full path as a slice of the directory arena; the
+    // directory's own name is the last nameLength bytes of the slice. A path with non-ASCII
+    // characters is followed by its SearchKey, foldedLength bytes; ASCII paths serve as
+    // their own key, since every consumer folds ASCII case itself.
+    struct DirectoryNode {
+        quint32 parent;
+        quint32 pathOffset;
+        quint32 pathLength;  // Without a trailing '/'
+        quint32 nameLength;
+        quint32 foldedLength;  // 0 for ASCII paths
+    };
+
+    void build(const QStringList &paths);
+    void adopt(const QSharedPointer<const IndexSnapshot> &snapshot);
+    void clear();
+
+    // Appends a new entry and returns its slot; id -1 assigns a fresh id
+    int append(const QString &path, int id = -1);
+    bool remove(int slot);
+    int slotOf(const QString &path);
+    void compact();
+
+    int size() const { return m_count; }
+    bool isEmpty() const { return m_count == m_removedCount; }
+    int liveCount() const { return m_count - m_removedCount; }
+    int removedCount() const { return m_removedCount; }
+    bool isRemoved(int index) const { return m_flags[index] & RemovedFlag; }
+
+    int entryId(int index) const { return m_slotIds.isEmpty() ? index : m_slotIds.at(index); }
+    int slotOfId(int id) const;
+
+    QString path(int index) const;
+    int pathLength(int index) const
+    {
+        const int directory = directoryOf(index);
+        return directory == NO_DIRECTORY ? nameLength(index)
+                                         : m_directoryNodes[directory].pathLength + 1 + nameLength(index);
+    }
+    // Writes the pathLength() bytes of the UTF-8 path to buffer
+    void copyPath(int index, char *buffer) const;
+    // The path as non-ASCII entries are matched: the directory's key, '/', the name's key
+    int foldedPathLength(int index) const
+    {
+        const int directory = directoryOf(index);
+        if (directory == NO_DIRECTORY) {
+            return lowerNameLength(index);
+        }
+        const DirectoryNode &node = m_directoryNodes[directory];
+        return (node.foldedLength ? node.foldedLength : node.pathLength) + 1 + lowerNameLength(index);
+    }
+    void copyFoldedPath(int index, char *buffer) const;
+    QString fileName(int index) const;
+
+    const char *name(int index) const { return m_nameArena + m_nameOffsets[index]; }
+    int nameLength(int index) const { return m_nameOffsets[index + 1] - m_nameOffsets[index]; }
+    int directoryOf(int index) const { return int(m_directories[index]); }
+
+    int directoryCount() const { return m_directoryCount; }
+    int parentDirectory(int directory) const { return int(m_directoryNodes[directory].parent); }
+    QString directoryPath(int directory) const;
+    // Id of the directory with exactly this path, or NO_DIRECTORY
+    int findDirectory(const QString &path) const;
+    // Live slots anywhere below the directory, ascending
+    QVector<int> entriesUnder(int directory) const;
+
+    const char *lowerName(int index) const { return m_lowerArena + m_lowerOffsets[index]; }
+    int lowerNameLength(int index) const
+    {
+        return m_lowerOffsets[index + 1] - m_lowerOffsets[index];
+    }
+    int lowerNameCharacters(int index) const
+    {
+        return (m_flags[index] & AsciiFlag) ? lowerNameLength(index)
+                                            : characterCount(lowerName(index), lowerNameLength(index));
+    }
+    quint8 flags(int index) const { return m_flags[index]; }
+    quint64 characterMask(int index) const { return m_charMasks[index]; }
+    quint64 pathMask(int index) const { return m_pathMasks[index]; }
+    quint64 wordInitials(int index) const { return m_wordInitials[index]; }
+
+    // Raw sections, laid out exactly as IndexSnapshot stores them
+    const char *nameArena() const { return m_nameArena; }
+    const char *lowerArena() const { return m_lowerArena; }
+    const quint32 *nameOffsets() const { return m_nameOffsets; }
+    const quint32 *lowerOffsets() const { return m_lowerOffsets; }
+    const quint32 *directoryData() const { return m_directories; }
+    const quint8 *flagData() const { return m_flags; }
+    const quint64 *characterMasks() const { return m_charMasks; }
+    const quint64 *pathMasks() const { return m_pathMasks; }
+    const quint64 *wordInitials() const { return m_wordInitials; }
+    const DirectoryNode *directoryNodes() const { return m_directoryNodes; }
+    const char *directoryArena() const { return m_directoryArena; }
+    int directoryArenaSize() const;
+
+private:
+    void bindOwned();
+    void detach();
+    void ensureIdTables();
+    void ensurePathTable();
+    void insertIntoPathTable(int slot);
+    bool pathEquals(int slot, const QByteArray &pathUtf8) const;
+
+    int internDirectory(const char *data, int length);
+    int lookupDirectory(const char *data, int length, uint hash) const;
+    void ensureDirectoryTable();
+    void insertIntoDirectoryTable(int directory);
+    bool directoryEquals(int directory, const char *data, int length) const;
+
+    QByteArray m_ownedNameArena;
+    QByteArray m_ownedLowerArena;
+    QVector<quint32> m_ownedNameOffsets;
+    QVector<quint32> m_ownedLowerOffsets;
+    QVector<quint32> m_ownedDirectories;
+    QVector<quint8> m_ownedFlags;
+    QVector<quint64> m_ownedCharMasks;
+    QVector<quint64> m_ownedPathMasks;
+    QVector<quint64> m_ownedWordInitials;
+    QByteArray m_ownedDirectoryArena;
+    QVector<DirectoryNode> m_ownedDirectoryNodes;
+    QSharedPointer<const IndexSnapshot> m_snapshot;
+
+    // Filled on the first modification; while empty every slot is its own id
+    QVector<int> m_slotIds;
+    QVector<int> m_idSlots;
+
+    // Open-addressing table of slots keyed by path hash, built on the first lookup
+    QVector<int> m_pathTable;
+    int m_pathTableUsed;
+
+    // Open-addressing table of directories keyed by path hash, built on the first insertion
+    QVector<int> m_directoryTable;
+    QVector<uint> m_directoryHashes;
+
+    int m_count;
+    int m_removedCount;
+    int m_directoryCount;
+    const char *m_nameArena;
+    const char *m_lowerArena;
+    const quint32 *m_nameOffsets;
+    const quint32 *m_lowerOffsets;
+    const quint32 *m_directories;
+    const quint8 *m_flags;
+    const quint64 *m_charMasks;
+    const quint64 *m_pathMasks;
+    const quint64 *m_wordInitials;
+    const DirectoryNode *m_directoryNodes;
+    const char *m_directoryArena;
+};
+
+#endif // ENTRYSTORE_H
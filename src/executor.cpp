@@ -0,0 +1,194 @@
+#include "executor.h"
+#include <QRunnable>
+#include <condition_variable>
+#include <memory>
+#include <vector>
+#ifdef Q_OS_LINUX
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Generation a lane thread last applied its lane's settings at; lane threads never switch lanes
+static thread_local int t_appliedGeneration = -1;
+
+#ifdef Q_OS_LINUX
+// The process's own mask, which "any CPU" goes back to rather than every CPU of the machine
+static cpu_set_t processCpus()
+{
+    static const cpu_set_t cpus = [] {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        return set;
+    }();
+    return cpus;
+}
+#endif
+
+static void setCurrentThreadPriority(QThread::Priority priority)
+{
+    QThread::currentThread()->setPriority(priority);
+#ifdef Q_OS_LINUX
+    // The default scheduler ignores thread priorities, but not a thread's own nice value
+    static const int processNice = getpriority(PRIO_PROCESS, 0);
+    const int offset = priority == QThread::LowestPriority ? 10 : priority == QThread::LowPriority ? 5 : 0;
+    setpriority(PRIO_PROCESS, id_t(syscall(SYS_gettid)), qMin(19, processNice + offset));
+#endif
+}
+
+static void pinCurrentThread(const QVector<int> &cpus)
+{
+#ifdef Q_OS_LINUX
+    cpu_set_t set = processCpus();
+    if (!cpus.isEmpty()) {
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    Q_UNUSED(cpus);
+#endif
+}
+
+class Executor::Task : public QRunnable
+{
+public:
+    Task(Executor *executor, Lane lane, std::function<void()> fn)
+        : m_executor(executor)
+        , m_lane(lane)
+        , m_fn(std::move(fn))
+    {
+    }
+    
+    void run() override
+    {
+        m_executor->prepareThread(m_lane);
+        m_fn();
+    }
+    
+private:
+    Executor *m_executor;
+    Lane m_lane;
+    std::function<void()> m_fn;
+};
+
+Executor &Executor::instance()
+{
+    static Executor executor;
+    return executor;
+}
+
+Executor::Executor()
+{
+#ifdef Q_OS_LINUX
+    processCpus();  // Taken before any lane thread narrows its own mask
+#endif
+    
+    // Background threads yield to searches and to the GUI; both lanes may use every core
+    const QThread::Priority priorities[LaneCount] = {QThread::NormalPriority, QThread::LowPriority};
+    for (int lane = 0; lane < LaneCount; ++lane) {
+        LaneState &state = m_lanes[lane];
+        state.settings.threads = QThread::idealThreadCount();
+        state.settings.priority = priorities[lane];
+        state.generation = 0;
+        state.pool.setMaxThreadCount(state.settings.threads);
+        state.pool.setExpiryTimeout(-1);
+    }
+}
+
+void Executor::setLaneSettings(Lane lane, const LaneSettings &settings)
+{
+    std::lock_guard<std::mutex> lock(m_settingsMutex);
+    LaneState &state = m_lanes[lane];
+    state.settings = settings;
+    state.settings.threads = qMax(1, settings.threads);
+    state.pool.setMaxThreadCount(state.settings.threads);
+    ++state.generation;
+}
+
+Executor::LaneSettings Executor::laneSettings(Lane lane) const
+{
+    std::lock_guard<std::mutex> lock(m_settingsMutex);
+    return m_lanes[lane].settings;
+}
+
+int Executor::threadCount(Lane lane) const
+{
+    return laneSettings(lane).threads;
+}
+
+void Executor::prepareThread(Lane lane)
+{
+    LaneState &state = m_lanes[lane];
+    const int generation = state.generation.load(std::memory_order_acquire);
+    if (generation == t_appliedGeneration) {
+        return;
+    }
+    
+    const LaneSettings settings = laneSettings(lane);
+    if (t_appliedGeneration < 0) {
+        setCurrentThreadPriority(settings.priority);
+    }
+    pinCurrentThread(settings.cpus);
+    t_appliedGeneration = generation;
+}
+
+void Executor::start(Lane lane, const std::function<void()> &task)
+{
+    // Queued tasks of a lane start in order, so a search is never stuck behind later work
+    m_lanes[lane].pool.start(new Task(this, lane, task));
+}
+
+void Executor::parallel(Lane lane, int workers, const std::function<void(int)> &work)
+{
+    if (workers <= 1) {
+        work(0);
+        return;
+    }
+    
+    QThreadPool &pool = m_lanes[lane].pool;
+    
+    // Helpers count themselves out under the lock as their very last action, so once the count
+    // reaches zero none of them touches this frame or its Task again
+    std::mutex mutex;
+    std::condition_variable exited;
+    int running = workers - 1;
+    
+    std::vector<std::unique_ptr<Task>> helpers;
+    helpers.reserve(workers - 1);
+    for (int worker = 1; worker < workers; ++worker) {
+        helpers.emplace_back(new Task(this, lane, [&work, &mutex, &exited, &running, worker]() {
+            work(worker);
+            std::lock_guard<std::mutex> lock(mutex);
+            --running;
+            exited.notify_all();
+        }));
+        helpers.back()->setAutoDelete(false);
+        pool.start(helpers.back().get());
+    }
+    
+    work(0);
+    
+    // Helpers still queued are run here instead of waited for
+    for (int i = 0; i < int(helpers.size()); ++i) {
+        if (pool.tryTake(helpers[i].get())) {
+            work(i + 1);
+            std::lock_guard<std::mutex> lock(mutex);
+            --running;
+        }
+    }
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    exited.wait(lock, [&running]() { return running == 0; });
+}
@@ -0,0 +1,67 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+// Persistent worker threads owned by the matching core, split into lanes so that scanning
+// and indexing never queue ahead of a keystroke's search or run at its priority. Searches
+// use the interactive lane; directory scans and index builds use the background lane.
+//
+// parallel() never leaves a lane thread waiting on queued work: the calling thread runs
+// worker 0 and then takes back every helper that has not started, running it itself. A loop
+// therefore finishes even when all threads of its lane are busy, nested loops included.
+class Executor
+{
+public:
+    enum Lane {
+        Interactive,
+        Background,
+        LaneCount
+    };
+    
+    struct LaneSettings {
+        int threads;
+        QThread::Priority priority;
+        QVector<int> cpus;  // CPUs the lane's threads may run on (Linux only); empty for any
+    };
+    
+    static Executor &instance();
+    
+    // Thread counts and CPU sets apply to threads as they pick up their next task. A thread's
+    // priority is set by the first task it runs and then kept, since an unprivileged process
+    // cannot raise a lowered priority again; set it before the lane is first used.
+    void setLaneSettings(Lane lane, const LaneSettings &settings);
+    LaneSettings laneSettings(Lane lane) const;
+    int threadCount(Lane lane) const;
+    
+    void start(Lane lane, const std::function<void()> &task);
+    
+    // Calls work(worker) once for every worker in [0, workers), on the calling thread and up
+    // to workers - 1 threads of the lane, and returns when all calls have
+    void parallel(Lane lane, int workers, const std::function<void(int)> &work);
+    
+private:
+    class Task;
+    
+    struct LaneState {
+        QThreadPool pool;
+        LaneSettings settings;
+        std::atomic<int> generation;  // Bumped by every settings change
+    };
+    
+    Executor();
+    Executor(const Executor &) = delete;
+    Executor &operator=(const Executor &) = delete;
+    
+    void prepareThread(Lane lane);
+    
+    LaneState m_lanes[LaneCount];
+    mutable std::mutex m_settingsMutex;
+};
+
+#endif // EXECUTOR_H
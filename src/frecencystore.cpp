@@ -0,0 +1,213 @@
+#include "frecencystore.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <cmath>
+#include <cstring>
+
+static const char LOG_MAGIC[4] = {'E', 'Z', 'F', 'U'};
+static const quint32 LOG_VERSION = 1;
+static const quint32 LOG_BYTE_ORDER = 0x01020304;
+static const double MIN_WEIGHT = 0.05;
+static const int MIN_REWRITE_RECORDS = 256;
+
+struct LogHeader {
+    char magic[4];
+    quint32 version;
+    quint32 byteOrder;
+    quint32 reserved;
+};
+
+struct RecordHeader {
+    qint64 msecs;
+    float weight;
+    quint32 pathSize;
+};
+
+static QByteArray encodeRecord(const QString &path, double weight, qint64 msecs)
+{
+    const QByteArray pathUtf8 = path.toUtf8();
+    RecordHeader header;
+    header.msecs = msecs;
+    header.weight = float(weight);
+    header.pathSize = pathUtf8.size();
+
+    QByteArray record(reinterpret_cast<const char *>(&header), sizeof(header));
+    record.append(pathUtf8);
+    return record;
+}
+
+static QByteArray encodeHeader()
+{
+    LogHeader header = {};
+    memcpy(header.magic, LOG_MAGIC, sizeof(header.magic));
+    header.version = LOG_VERSION;
+    header.byteOrder = LOG_BYTE_ORDER;
+    return QByteArray(reinterpret_cast<const char *>(&header), sizeof(header));
+}
+
+FrecencyStore::FrecencyStore()
+    : m_records(0)
+{
+}
+
+QString FrecencyStore::storePath(const QString &rootDir)
+{
+    const QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    const QByteArray key = QCryptographicHash::hash(QDir::cleanPath(rootDir).toUtf8(),
+                                                    QCryptographicHash::Sha1).toHex();
+    return dataDir + "/usage/" + QString::fromLatin1(key) + ".ezuse";
+}
+
+double FrecencyStore::decayed(const Usage &usage, qint64 msecs)
+{
+    static const double halfLifeMSecs = HALF_LIFE_DAYS * 24.0 * 60 * 60 * 1000;
+    return usage.weight * std::exp2(-double(msecs - usage.msecs) / halfLifeMSecs);
+}
+
+void FrecencyStore::addRecord(Usage &usage, double weight, qint64 msecs)
+{
+    // Bring whichever side is older up to the newer time before adding
+    if (msecs >= usage.msecs) {
+        usage.weight = decayed(usage, msecs) + weight;
+        usage.msecs = msecs;
+    } else {
+        usage.weight += decayed({weight, msecs}, usage.msecs);
+    }
+}
+
+bool FrecencyStore::open(const QString &rootDir)
+{
+    close();
+    m_rootDir = QDir::cleanPath(rootDir);
+
+    QFile file(storePath(m_rootDir));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return !file.exists();
+    }
+
+    const QByteArray data = file.readAll();
+    const LogHeader *header = reinterpret_cast<const LogHeader *>(data.constData());
+    if (data.size() < int(sizeof(LogHeader)) ||
+        memcmp(header->magic, LOG_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != LOG_VERSION || header->byteOrder != LOG_BYTE_ORDER) {
+        return false;
+    }
+
+    // A record cut short by a crash ends the log
+    int offset = sizeof(LogHeader);
+    while (offset + int(sizeof(RecordHeader)) <= data.size()) {
+        RecordHeader record;
+        memcpy(&record, data.constData() + offset, sizeof(record));
+        offset += sizeof(record);
+        if (record.pathSize > quint32(data.size() - offset)) {
+            break;
+        }
+
+        const QString path = QString::fromUtf8(data.constData() + offset, record.pathSize);
+        offset += record.pathSize;
+
+        auto it = m_usage.find(path);
+        if (it == m_usage.end()) {
+            m_usage.insert(path, {record.weight, record.msecs});
+        } else {
+            addRecord(*it, record.weight, record.msecs);
+        }
+        ++m_records;
+    }
+
+    if (m_records > MIN_REWRITE_RECORDS && m_records > m_usage.size() * 2) {
+        rewrite();
+    }
+    return true;
+}
+
+void FrecencyStore::close()
+{
+    m_rootDir.clear();
+    m_usage.clear();
+    m_records = 0;
+}
+
+bool FrecencyStore::rewrite() const
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    QSaveFile file(storePath(m_rootDir));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QByteArray data = encodeHeader();
+    for (auto it = m_usage.constBegin(); it != m_usage.constEnd(); ++it) {
+        if (decayed(it.value(), now) >= MIN_WEIGHT) {
+            data.append(encodeRecord(it.key(), it.value().weight, it.value().msecs));
+        }
+    }
+
+    if (file.write(data) != data.size()) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+bool FrecencyStore::record(const QString &path)
+{
+    if (!isOpen()) {
+        return false;
+    }
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    auto it = m_usage.find(path);
+    if (it == m_usage.end()) {
+        m_usage.insert(path, {1.0, now});
+    } else {
+        addRecord(*it, 1.0, now);
+    }
+    ++m_records;
+
+    const QString filePath = storePath(m_rootDir);
+    if (!QDir().mkpath(QFileInfo(filePath).absolutePath())) {
+        return false;
+    }
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        return false;
+    }
+
+    QByteArray data = file.size() == 0 ? encodeHeader() : QByteArray();
+    data.append(encodeRecord(path, 1.0, now));
+    return file.write(data) == data.size();
+}
+
+double FrecencyStore::weight(const QString &path) const
+{
+    auto it = m_usage.constFind(path);
+    if (it == m_usage.constEnd()) {
+        return 0.0;
+    }
+
+    const double weight = decayed(it.value(), QDateTime::currentMSecsSinceEpoch());
+    return weight >= MIN_WEIGHT ? weight : 0.0;
+}
+
+QHash<QString, double> FrecencyStore::weights() const
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    QHash<QString, double> result;
+    result.reserve(m_usage.size());
+    for (auto it = m_usage.constBegin(); it != m_usage.constEnd(); ++it) {
+        const double weight = decayed(it.value(), now);
+        if (weight >= MIN_WEIGHT) {
+            result.insert(it.key(), weight);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,50 @@
+#ifndef FRECENCYSTORE_H
+#define FRECENCYSTORE_H
+
+#include <QString>
+#include <QHash>
+#include <QtGlobal>
+
+// Append-only log of the files picked from search results, one log per root directory.
+// Every pick appends a small record; loading folds the records into one weight per path that
+// halves every HALF_LIFE_DAYS, so both frequent and recent picks count. A log that holds far
+// more records than paths is rewritten with one record per path when it is opened.
+//
+// Record layout (native byte order, after a LogHeader):
+//   qint64 msecs, float weight, quint32 path size, path (UTF-8)
+class FrecencyStore
+{
+public:
+    static const int HALF_LIFE_DAYS = 14;
+
+    FrecencyStore();
+
+    static QString storePath(const QString &rootDir);
+
+    bool open(const QString &rootDir);
+    void close();
+    bool isOpen() const { return !m_rootDir.isEmpty(); }
+
+    // Appends a pick of path at the current time
+    bool record(const QString &path);
+
+    // Weights decayed to the current time; paths that have faded out are left out
+    double weight(const QString &path) const;
+    QHash<QString, double> weights() const;
+
+private:
+    struct Usage {
+        double weight;
+        qint64 msecs;  // Time the weight was last brought up to date
+    };
+
+    static double decayed(const Usage &usage, qint64 msecs);
+    static void addRecord(Usage &usage, double weight, qint64 msecs);
+    bool rewrite() const;
+
+    QString m_rootDir;
+    QHash<QString, Usage> m_usage;
+    int m_records;
+};
+
+#endif // FRECENCYSTORE_H
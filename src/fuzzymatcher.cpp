@@ -1,178 +1,1400 @@
 #include "fuzzymatcher.h"
+#include "indexsnapshot.h"
+#include "instrumentation.h"
+#include "searchkey.h"
+#include <QDir>
 #include <QFileInfo>
-#include <QtConcurrent>
 #include <QDebug>
-#include <QRegularExpression>
+#include <QtAlgorithms>
+#include <QElapsedTimer>
+#include <QFutureInterface>
+#include <QVarLengthArray>
+#include <cmath>
+#include <cstring>
+#include <iterator>
 
 FuzzyMatcher::FuzzyMatcher()
+    : m_scoringMode(NameScoring)
+    , m_pathRootKeyLength(0)
+    , m_trigramIndexEnabled(true)
 {
 }
 
+static const int MAX_NARROWING_DEPTH = 16;
+static const int MIN_COMPACTION_TOMBSTONES = 1024;
+static const int MIN_SUBSTRING_SCORE = 600;
+static const int PATH_LENGTH_RANGE = 256;
+static const int MAX_TYPO_SCORE = 500;
+
+// Called once per scored chunk, so the shared counters stay off the per-entry path
+static void countPrefilter(int visited, int plausible)
+{
+    Instrumentation &instrumentation = Instrumentation::instance();
+    instrumentation.count(Instrumentation::Candidates, plausible);
+    instrumentation.count(Instrumentation::PrefilterRejects, visited - plausible);
+}
+
 void FuzzyMatcher::setCollection(const QStringList &collection)
 {
+    Instrumentation::Span span(Instrumentation::Index);
+    m_queryCache.clear();
+    m_narrowingStack.clear();
+    m_usageBoosts.clear();
+    
+    m_entries.build(collection);
+    m_typos.build(m_entries);
+    rebuildTrigramIndex();
+    rebuildPathMasks();
+}
+
+void FuzzyMatcher::setCollection(const QSharedPointer<const IndexSnapshot> &snapshot)
+{
+    Instrumentation::Span span(Instrumentation::Index);
+    m_queryCache.clear();
+    m_narrowingStack.clear();
+    m_usageBoosts.clear();
+    
+    // Searches run directly against the mapped snapshot arrays
+    m_entries.adopt(snapshot);
+    m_typos.build(m_entries);
+    rebuildTrigramIndex();
+    rebuildPathMasks();
+}
+
+void FuzzyMatcher::addToIndexes(int slot)
+{
+    const char *original = (m_entries.flags(slot) & EntryStore::AsciiFlag) ? m_entries.name(slot) : nullptr;
+    m_typos.add(slot, m_entries.lowerName(slot), original, m_entries.lowerNameLength(slot));
+    
+    if (m_trigramIndexEnabled) {
+        m_trigrams.add(slot, m_entries.lowerName(slot), m_entries.lowerNameLength(slot));
+    }
+    if (!m_pathRoot.isEmpty()) {
+        m_rootedPathMasks.append(rootedPathMask(slot));
+    }
+}
+
+void FuzzyMatcher::rebuildTrigramIndex()
+{
+    if (m_trigramIndexEnabled) {
+        m_trigrams.build(m_entries);
+    } else {
+        m_trigrams.clear();
+    }
+}
+
+void FuzzyMatcher::setScoringMode(ScoringMode mode)
+{
+    if (mode == m_scoringMode) {
+        return;
+    }
+    
+    // Cached results and survivor lists were ranked by the other scorer
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    m_scoringMode = mode;
+    m_queryCache.clear();
+    m_narrowingStack.clear();
+}
+
+void FuzzyMatcher::setPathRoot(const QString &root)
+{
+    QString cleaned = root.isEmpty() ? QString() : QDir::cleanPath(root);
+    if (cleaned.endsWith('/')) {
+        cleaned.chop(1);
+    }
+    if (cleaned == m_pathRoot) {
+        return;
+    }
+    
+    m_pathRoot = cleaned;
+    m_pathRootUtf8 = cleaned.toUtf8();
+    m_pathRootKeyLength = SearchKey::foldToUtf8(cleaned).size();
+    rebuildPathMasks();
+    
+    // Cached rankings and survivor lists saw the root
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
     m_queryCache.clear();
+    m_narrowingStack.clear();
+}
+
+void FuzzyMatcher::setCacheBudget(qint64 bytes)
+{
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    m_queryCache.setBudget(bytes);
+}
+
+qint64 FuzzyMatcher::cacheBudget() const
+{
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    return m_queryCache.budget();
+}
+
+void FuzzyMatcher::setTrigramIndexEnabled(bool enabled)
+{
+    if (enabled == m_trigramIndexEnabled) {
+        return;
+    }
+    
+    m_trigramIndexEnabled = enabled;
+    rebuildTrigramIndex();
+}
+
+static int usageBoostOf(double weight)
+{
+    // Logarithmic, so a handful of recent picks counts nearly as much as hundreds
+    return qBound(0, int(std::log2(1.0 + weight) * 10), FuzzyMatcher::MAX_USAGE_BOOST);
+}
+
+void FuzzyMatcher::setUsageWeights(const QHash<QString, double> &weights)
+{
+    m_usageBoosts.clear();
+    for (auto it = weights.constBegin(); it != weights.constEnd(); ++it) {
+        setUsageWeight(it.key(), it.value());
+    }
     
-    if (collection.isEmpty()) {
-        m_entries.clear();
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    m_queryCache.clear();
+}
+
+void FuzzyMatcher::setUsageWeight(const QString &path, double weight)
+{
+    const int slot = m_entries.slotOf(path);
+    if (slot < 0) {
         return;
     }
     
-    m_entries.clear();
-    m_entries.reserve(collection.size());
+    const int id = m_entries.entryId(slot);
+    if (id >= m_usageBoosts.size()) {
+        m_usageBoosts.resize(id + 1);
+    }
+    m_usageBoosts[id] = usageBoostOf(weight);
+    
+    // Cached rankings were made with the old boost; survivor lists don't depend on it
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    m_queryCache.clear();
+}
+
+QVector<int> FuzzyMatcher::addPaths(const QStringList &paths)
+{
+    Instrumentation::Span span(Instrumentation::Index);
+    QVector<int> ids;
+    QVector<int> addedSlots;
+    ids.reserve(paths.size());
     
-    QVector<FileEntry> entries;
-    entries.resize(collection.size());
+    for (const QString &path : paths) {
+        int slot = m_entries.slotOf(path);
+        if (slot < 0) {
+            slot = m_entries.append(path);
+            addToIndexes(slot);
+            addedSlots.append(slot);
+        }
+        ids.append(m_entries.entryId(slot));
+    }
+    
+    if (!addedSlots.isEmpty()) {
+        // New entries may match any earlier query, so no retained survivor list is complete
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        m_narrowingStack.clear();
+        mergeIntoCachedResults(addedSlots);
+    }
+    return ids;
+}
+
+int FuzzyMatcher::removePaths(const QStringList &paths)
+{
+    Instrumentation::Span span(Instrumentation::Index);
+    QSet<int> removedIds;
     
-    QtConcurrent::blockingMap(collection, [&entries, &collection](const QString &path) {
-        int index = collection.indexOf(path);
-        QFileInfo fileInfo(path);
+    for (const QString &path : paths) {
+        const int slot = m_entries.slotOf(path);
+        if (m_entries.remove(slot)) {
+            removedIds.insert(m_entries.entryId(slot));
+        }
+    }
+    
+    if (!removedIds.isEmpty()) {
+        // Tombstoned slots are skipped by the scorer, so the survivor lists stay usable
+        {
+            std::lock_guard<std::mutex> lock(m_cacheMutex);
+            dropFromCachedResults(removedIds);
+        }
+        compactIfSparse();
+    }
+    return removedIds.size();
+}
+
+bool FuzzyMatcher::renamePath(const QString &from, const QString &to)
+{
+    const int slot = m_entries.slotOf(from);
+    if (slot < 0 || m_entries.slotOf(to) >= 0) {
+        return false;
+    }
+    
+    const int id = m_entries.entryId(slot);
+    m_entries.remove(slot);
+    const int renamedSlot = m_entries.append(to, id);
+    addToIndexes(renamedSlot);
+    
+    {
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        m_narrowingStack.clear();
+        dropFromCachedResults(QSet<int>{id});
+        mergeIntoCachedResults(QVector<int>{renamedSlot});
+    }
+    compactIfSparse();
+    return true;
+}
+
+void FuzzyMatcher::dropFromCachedResults(const QSet<int> &ids)
+{
+    // Whatever remains of a best-k list is still the best of the remaining entries
+    m_queryCache.update([&ids](const QString &, QueryCache::Result &result) {
+        int kept = 0;
+        for (int i = 0; i < result.ids.size(); ++i) {
+            if (!ids.contains(result.ids.at(i))) {
+                result.ids[kept] = result.ids.at(i);
+                result.scores[kept] = result.scores.at(i);
+                ++kept;
+            }
+        }
+        result.ids.resize(kept);
+        result.scores.resize(kept);
+    });
+}
+
+void FuzzyMatcher::mergeIntoCachedResults(const QVector<int> &addedSlots)
+{
+    m_queryCache.update([this, &addedSlots](const QString &query, QueryCache::Result &result) {
+        const CompiledQuery compiled(QueryPlan(query), *this);
         
-        entries[index].fullPath = path;
-        entries[index].fileName = fileInfo.fileName();
-        entries[index].lowerName = fileInfo.fileName().toLower();
+        for (int slot : addedSlots) {
+            const int score = scorePlan(compiled, slot);
+            if (score <= 0) {
+                continue;
+            }
+            
+            // A truncated list only takes entries that displace its current last one
+            const TopKSelector::ScoredEntry candidate(slot, score);
+            int position = result.ids.size();
+            while (position > 0 &&
+                   TopKSelector::ranksBefore(candidate, TopKSelector::ScoredEntry(m_entries.slotOfId(result.ids.at(position - 1)),
+                                                                                  result.scores.at(position - 1)))) {
+                --position;
+            }
+            if (!result.complete && position == result.ids.size()) {
+                continue;
+            }
+            
+            result.ids.insert(position, m_entries.entryId(slot));
+            result.scores.insert(position, score);
+            if (!result.complete) {
+                result.ids.removeLast();
+                result.scores.removeLast();
+            }
+        }
     });
+}
+
+void FuzzyMatcher::compactIfSparse()
+{
+    // Compaction moves slots, which invalidates the indexes and survivor lists
+    const int removed = m_entries.removedCount();
+    if (removed < MIN_COMPACTION_TOMBSTONES || removed * 4 < m_entries.size()) {
+        return;
+    }
+    
+    m_entries.compact();
+    m_typos.build(m_entries);
+    rebuildTrigramIndex();
+    rebuildPathMasks();
     
-    m_entries = entries;
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    m_narrowingStack.clear();
 }
 
-QStringList FuzzyMatcher::search(const QString &query, int maxResults) const
+bool FuzzyMatcher::narrowCandidates(const QString &query, const PreparedQuery &prepared, QVector<int> &candidates) const
 {
-    const QString queryLower = query.toLower();
+    const QByteArray &queryLower = prepared.utf8;
+    QByteArray previousQuery;
+    QVector<int> survivors;
     
-    if (queryLower.isEmpty()) {
-        QStringList results;
-        results.reserve(qMin(maxResults, m_entries.size()));
+    {
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
         
-        for (int i = 0; i < qMin(maxResults, m_entries.size()); ++i) {
-            results.append(m_entries.at(i).fullPath);
+        // Backspace pops back to the longest retained query that still prefixes this one
+        while (!m_narrowingStack.isEmpty() && !queryLower.startsWith(m_narrowingStack.last().query)) {
+            m_narrowingStack.removeLast();
         }
-        return results;
+        
+        if (!m_narrowingStack.isEmpty()) {
+            previousQuery = m_narrowingStack.last().query;
+            survivors = m_narrowingStack.last().survivors;
+        }
+        
+        // A complete cached result for a longer prefix lists every entry that matched it
+        QueryCache::Result cached;
+        for (int length = query.size() - 1; length > 0; --length) {
+            const QString prefix = query.left(length);
+            if (prefix.toUtf8().size() <= previousQuery.size()) {
+                break;
+            }
+            if (QueryPlan::isSimpleQuery(prefix) && m_queryCache.lookup(prefix, cached) && cached.complete) {
+                previousQuery = prefix.toUtf8();
+                survivors.resize(cached.ids.size());
+                for (int i = 0; i < cached.ids.size(); ++i) {
+                    survivors[i] = m_entries.slotOfId(cached.ids.at(i));
+                }
+                std::sort(survivors.begin(), survivors.end());
+                break;
+            }
+        }
+        
+        if (previousQuery.isEmpty()) {
+            return false;
+        }
+    }
+    
+    // Every tier except the typo tier implies the shorter query is a subsequence of the name,
+    // so only the longer query's typo matches can join the survivors
+    if (prepared.typoScores.isEmpty()) {
+        candidates = survivors;
+        return true;
     }
     
+    QVector<int> typos;
+    typos.reserve(prepared.typoScores.size());
+    for (const QPair<int, int> &typo : prepared.typoScores) {
+        typos.append(typo.first);
+    }
+    
+    candidates.clear();
+    candidates.reserve(survivors.size() + typos.size());
+    std::set_union(survivors.constBegin(), survivors.constEnd(),
+                   typos.constBegin(), typos.constEnd(),
+                   std::back_inserter(candidates));
+    return true;
+}
+
+void FuzzyMatcher::pushNarrowingLevel(const QByteArray &queryLower, const QVector<int> &survivors) const
+{
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    
+    while (!m_narrowingStack.isEmpty() && !queryLower.startsWith(m_narrowingStack.last().query)) {
+        m_narrowingStack.removeLast();
+    }
+    if (!m_narrowingStack.isEmpty() && m_narrowingStack.last().query == queryLower) {
+        m_narrowingStack.removeLast();
+    }
+    
+    NarrowingLevel level;
+    level.query = queryLower;
+    level.survivors = survivors;
+    m_narrowingStack.append(level);
+    
+    if (m_narrowingStack.size() > MAX_NARROWING_DEPTH) {
+        m_narrowingStack.removeFirst();
+    }
+}
+
+struct FuzzyMatcher::SearchControl
+{
+    SearchControl(QFutureInterface<SearchUpdate> &future, int maxResults, int previewSize)
+        : future(future)
+        , previewSize(previewSize)
+        , progress(maxResults)
+        , scored(0)
+        , lastPreview(0)
+        , nextResultIndex(0)
     {
-        std::lock_guard<std::mutex> lock(m_cacheMutex);
-        if (m_queryCache.contains(queryLower)) {
-            QStringList cachedResults = m_queryCache.value(queryLower);
-            return cachedResults.mid(0, maxResults);
+        clock.start();
+    }
+    
+    bool isCanceled() const { return future.isCanceled(); }
+    
+    QFutureInterface<SearchUpdate> &future;
+    const int previewSize;
+    QElapsedTimer clock;
+    
+    std::mutex mutex;
+    TopKSelector progress;  // Union of every finished chunk's best matches
+    int scored;
+    qint64 lastPreview;
+    int nextResultIndex;
+};
+
+QStringList FuzzyMatcher::search(const QString &query, int maxResults, const QString &extension) const
+{
+    return runSearch(query, extension, maxResults, nullptr);
+}
+
+QFuture<FuzzyMatcher::SearchUpdate> FuzzyMatcher::searchAsync(const QString &query, int maxResults, int previewSize,
+                                                               const QString &extension) const
+{
+    QFutureInterface<SearchUpdate> future;
+    future.reportStarted();
+    
+    Executor::instance().start(Executor::Interactive, [this, query, extension, maxResults, previewSize, future]() mutable {
+        SearchControl control(future, maxResults, previewSize);
+        
+        if (!future.isCanceled()) {
+            SearchUpdate update;
+            update.results = runSearch(query, extension, maxResults, &control);
+            update.complete = true;
+            
+            // A cancelled future drops the result, so a stale answer never reaches the caller
+            std::lock_guard<std::mutex> lock(control.mutex);
+            future.reportResult(update, control.nextResultIndex++);
         }
+        future.reportFinished();
+    });
+    
+    return future.future();
+}
+
+void FuzzyMatcher::publishPreview(SearchControl *control, const TopKSelector &chunkResults, int scored) const
+{
+    std::lock_guard<std::mutex> lock(control->mutex);
+    
+    control->progress.merge(chunkResults);
+    control->scored += scored;
+    control->future.setProgressValue(control->scored);
+    
+    const qint64 now = control->clock.elapsed();
+    if (control->previewSize <= 0 || now - control->lastPreview < PREVIEW_INTERVAL_MS) {
+        return;
+    }
+    control->lastPreview = now;
+    
+    const QVector<TopKSelector::ScoredEntry> best = control->progress.sorted();
+    
+    SearchUpdate update;
+    update.results.reserve(qMin(best.size(), control->previewSize));
+    for (int i = 0; i < best.size() && i < control->previewSize; ++i) {
+        update.results.append(m_entries.path(best.at(i).first));
+    }
+    control->future.reportResult(update, control->nextResultIndex++);
+}
+
+QStringList FuzzyMatcher::firstEntries(int maxResults) const
+{
+    QStringList results;
+    results.reserve(qMin(maxResults, m_entries.liveCount()));
+    
+    for (int i = 0; i < m_entries.size() && results.size() < maxResults; ++i) {
+        if (!m_entries.isRemoved(i)) {
+            results.append(m_entries.path(i));
+        }
+    }
+    return results;
+}
+
+bool FuzzyMatcher::lookupCachedResults(const QString &queryLower, int maxResults, QStringList &results) const
+{
+    // A cached list answers any request it holds enough entries for
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    QueryCache::Result cached;
+    if (!m_queryCache.lookup(queryLower, cached) ||
+        (!cached.complete && cached.ids.size() < maxResults)) {
+        Instrumentation::instance().count(Instrumentation::CacheMisses);
+        return false;
+    }
+    Instrumentation::instance().count(Instrumentation::CacheHits);
+    
+    results.clear();
+    results.reserve(qMin(maxResults, cached.ids.size()));
+    for (int i = 0; i < cached.ids.size() && i < maxResults; ++i) {
+        results.append(m_entries.path(m_entries.slotOfId(cached.ids.at(i))));
+    }
+    return true;
+}
+
+QStringList FuzzyMatcher::storeResults(const QString &queryLower, const QVector<TopKSelector::ScoredEntry> &winners,
+                                       bool complete) const
+{
+    // Only the winners are turned back into path strings
+    QStringList results;
+    QueryCache::Result cached;
+    results.reserve(winners.size());
+    cached.ids.reserve(winners.size());
+    cached.scores.reserve(winners.size());
+    cached.complete = complete;
+    
+    for (const TopKSelector::ScoredEntry &winner : winners) {
+        results.append(m_entries.path(winner.first));
+        cached.ids.append(m_entries.entryId(winner.first));
+        cached.scores.append(winner.second);
+    }
+    
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    m_queryCache.insert(queryLower, cached);
+    return results;
+}
+
+QStringList FuzzyMatcher::runSearch(const QString &query, const QString &extension, int maxResults,
+                                    SearchControl *control) const
+{
+    Instrumentation::Span span(Instrumentation::Search);
+    QueryPlan plan(SearchKey::fold(query));
+    if (!extension.isEmpty()) {
+        plan.restrictExtension(SearchKey::fold(extension));
+    }
+    
+    if (plan.isEmpty()) {
+        return firstEntries(maxResults);
+    }
+    
+    const QString queryLower = plan.key();
+    
+    QStringList results;
+    if (lookupCachedResults(queryLower, maxResults, results)) {
+        return results;
     }
     
     if (m_entries.isEmpty()) {
         return QStringList();
     }
     
-    const int batchSize = 1000;
-    QVector<QVector<FileEntry>> batches;
+    QVector<TopKSelector::ScoredEntry> winners;
+    bool complete = false;
     
-    for (int i = 0; i < m_entries.size(); i += batchSize) {
-        int end = qMin(i + batchSize, m_entries.size());
-        batches.append(m_entries.mid(i, end - i));
+    const bool finished = plan.isSimple() ? searchTerm(queryLower, maxResults, control, winners, complete)
+                                          : searchPlan(plan, maxResults, control, winners, complete);
+    if (!finished) {
+        return QStringList();
     }
     
-    QVector<QPair<QString, int>> scoredStrings;
-    std::mutex resultsMutex;
+    return storeResults(queryLower, winners, complete);
+}
+
+bool FuzzyMatcher::searchIndexed(const QueryPlan &plan, int maxResults, QStringList &results) const
+{
+    // The trigram index narrows these down further than a shared sweep would
+    QVector<TopKSelector::ScoredEntry> winners;
+    bool complete = false;
+    
+    if (plan.isSimple()) {
+        TopKSelector substringResults(maxResults);
+        if (m_scoringMode != NameScoring || !searchSubstrings(PreparedQuery(plan.key()), substringResults)) {
+            return false;
+        }
+        winners = substringResults.sorted();
+    } else {
+        const QByteArray required = plan.longestRequiredSubstring(m_scoringMode == PathScoring);
+        if (!m_trigramIndexEnabled || required.size() < 3) {
+            return false;
+        }
+        searchPlan(plan, maxResults, nullptr, winners, complete);
+    }
     
-    QtConcurrent::blockingMap(batches, [this, &queryLower, &scoredStrings, &resultsMutex](const QVector<FileEntry> &batch) {
-        scoreFileBatch(queryLower, batch, scoredStrings, resultsMutex);
+    results = storeResults(plan.key(), winners, complete);
+    return true;
+}
+
+QVector<QStringList> FuzzyMatcher::searchBatch(const QStringList &queries, int maxResults) const
+{
+    Instrumentation::Span span(Instrumentation::Search);
+    QVector<QStringList> results(queries.size());
+    
+    // Empty, cached, repeated and index-narrowed queries are answered without the sweep
+    std::vector<CompiledQuery> compiled;
+    QStringList keys;
+    QHash<QString, int> keyIndex;
+    QVector<int> sweepIndex(queries.size(), -1);
+    
+    for (int q = 0; q < queries.size(); ++q) {
+        const QueryPlan plan(SearchKey::fold(queries.at(q)));
+        if (plan.isEmpty()) {
+            results[q] = firstEntries(maxResults);
+            continue;
+        }
+        
+        const QString queryLower = plan.key();
+        auto it = keyIndex.constFind(queryLower);
+        if (it != keyIndex.constEnd()) {
+            sweepIndex[q] = it.value();
+        } else if (!lookupCachedResults(queryLower, maxResults, results[q]) && !m_entries.isEmpty() &&
+                   !searchIndexed(plan, maxResults, results[q])) {
+            sweepIndex[q] = compiled.size();
+            keyIndex.insert(queryLower, compiled.size());
+            keys.append(queryLower);
+            compiled.emplace_back(plan, *this);
+        }
+    }
+    
+    const int count = int(compiled.size());
+    if (count == 0) {
+        return results;
+    }
+    
+    const int total = m_entries.size();
+    const int chunkSize = 2048;
+    const int workers = RangeScheduler::workerCount(total, chunkSize);
+    
+    // One selector and match count per worker and query, laid out worker-major
+    std::vector<TopKSelector> workerResults(size_t(workers) * count, TopKSelector(maxResults));
+    std::vector<int> workerMatches(size_t(workers) * count, 0);
+    
+    RangeScheduler::run(total, workers, chunkSize, [&](int worker, int begin, int end) {
+        TopKSelector *queryResults = &workerResults[size_t(worker) * count];
+        int *queryMatches = &workerMatches[size_t(worker) * count];
+        int plausibleCount = 0;
+        
+        // Every query scores a block while its masks, offsets and names are still in cache
+        for (int block = begin; block < end; block += 64) {
+            const int blockEnd = qMin(block + 64, end);
+            
+            for (int q = 0; q < count; ++q) {
+                quint64 plausibleBits = plausibleEntries(compiled[q], nullptr, block, blockEnd);
+                plausibleCount += qPopulationCount(plausibleBits);
+                while (plausibleBits) {
+                    const int entry = block + qCountTrailingZeroBits(plausibleBits);
+                    plausibleBits &= plausibleBits - 1;
+                    
+                    const int score = scorePlan(compiled[q], entry);
+                    if (score > 0) {
+                        queryResults[q].push(entry, score);
+                        ++queryMatches[q];
+                    }
+                }
+            }
+        }
+        countPrefilter((end - begin) * count, plausibleCount);
     });
     
-    std::sort(scoredStrings.begin(), scoredStrings.end(), 
-              [](const QPair<QString, int> &a, const QPair<QString, int> &b) {
-                  return a.second > b.second;
-              });
+    QVector<QStringList> sweptResults(count);
+    for (int q = 0; q < count; ++q) {
+        TopKSelector topResults(maxResults);
+        int matches = 0;
+        for (int worker = 0; worker < workers; ++worker) {
+            topResults.merge(workerResults[size_t(worker) * count + q]);
+            matches += workerMatches[size_t(worker) * count + q];
+        }
+        sweptResults[q] = storeResults(keys.at(q), topResults.sorted(), matches <= maxResults);
+    }
+    
+    for (int q = 0; q < queries.size(); ++q) {
+        if (sweepIndex.at(q) >= 0) {
+            results[q] = sweptResults.at(sweepIndex.at(q));
+        }
+    }
+    return results;
+}
+
+QStringList FuzzyMatcher::searchWithin(const QString &directory, const QString &query, int maxResults) const
+{
+    Instrumentation::Span span(Instrumentation::Search);
+    const QVector<int> candidates = m_entries.entriesUnder(m_entries.findDirectory(directory));
+    const QueryPlan plan(SearchKey::fold(query));
     
     QStringList results;
-    int count = qMin(maxResults, scoredStrings.size());
-    results.reserve(count);
+    if (plan.isEmpty()) {
+        for (int i = 0; i < candidates.size() && i < maxResults; ++i) {
+            results.append(m_entries.path(candidates.at(i)));
+        }
+        return results;
+    }
+    if (candidates.isEmpty()) {
+        return results;
+    }
+    
+    // Simple queries go through the compound scorer too; it ranks them exactly as search() does
+    const CompiledQuery compiled(plan, *this);
+    TopKSelector topResults(maxResults);
+    QVector<int> survivors;
+    scan(&candidates, maxResults, nullptr,
+         [&](const int *candidateData, int begin, int end, TopKSelector &target, QVector<int> &chunkSurvivors) {
+        scorePlanBatch(compiled, candidateData, begin, end, target, chunkSurvivors);
+    }, topResults, survivors);
     
-    for (int i = 0; i < count; ++i) {
-        results.append(scoredStrings[i].first);
+    for (const TopKSelector::ScoredEntry &winner : topResults.sorted()) {
+        results.append(m_entries.path(winner.first));
+    }
+    return results;
+}
+
+QVector<QVector<int>> FuzzyMatcher::matchPositions(const QString &query, const QStringList &paths) const
+{
+    QVector<QVector<int>> positions(paths.size());
+    const QueryPlan plan(SearchKey::fold(query));
+    if (plan.terms().isEmpty()) {
+        return positions;
     }
     
-    {
-        std::lock_guard<std::mutex> lock(m_cacheMutex);
-        if (!results.isEmpty() && m_queryCache.size() < 1000) {
-            m_queryCache[queryLower] = results;
+    const CompiledQuery compiled(plan, *this);
+    QVarLengthArray<int, 256> charAt;
+    QVarLengthArray<int, 64> matched;
+    
+    for (int p = 0; p < paths.size(); ++p) {
+        const QString &path = paths.at(p);
+        const int nameStart = path.lastIndexOf('/') + 1;
+        
+        // Name scoring only ever looks at the file name, path scoring at the path below the root
+        int start = 0;
+        if (m_scoringMode == NameScoring) {
+            start = nameStart;
+        } else if (!m_pathRoot.isEmpty() && path.size() > m_pathRoot.size() && path.at(m_pathRoot.size()) == '/' &&
+                   path.startsWith(m_pathRoot)) {
+            start = m_pathRoot.size() + 1;
+        }
+        
+        // ASCII paths are aligned as spelled, like alignPath() does, so camelCase humps earn the
+        // same bonus; every other text is aligned on its key
+        bool asciiPath = m_scoringMode == PathScoring;
+        for (int i = 0; i < path.size() && asciiPath; ++i) {
+            asciiPath = path.at(i).unicode() < 0x80;
+        }
+        QByteArray text;
+        if (asciiPath) {
+            text = path.mid(start).toLatin1();
+            charAt.resize(text.size());
+            for (int k = 0; k < text.size(); ++k) {
+                charAt[k] = start + k;
+            }
+        } else {
+            text = SearchKey::foldToUtf8(path, start, &charAt);
+        }
+        int nameOffset = 0;
+        if (m_scoringMode == PathScoring) {
+            while (nameOffset < charAt.size() && charAt[nameOffset] < nameStart) {
+                ++nameOffset;
+            }
+        }
+        
+        QVector<int> &row = positions[p];
+        for (size_t i = 0; i < compiled.terms.size(); ++i) {
+            const QByteArray &term = compiled.terms[i].utf8;
+            
+            // The substring tiers rank names holding the term, so that is what gets marked
+            const int at = m_scoringMode == NameScoring ? text.indexOf(term) : -1;
+            if (at >= 0) {
+                for (int k = at; k < at + term.size(); ++k) {
+                    row.append(charAt[k]);
+                }
+                continue;
+            }
+            
+            // Anything else, acronyms included, is marked where the path alignment puts it;
+            // names that only matched with typos have nothing to mark
+            matched.resize(term.size());
+            if (compiled.pathScorers[i].align(text.constData(), text.size(), nameOffset, matched.data()) > 0) {
+                for (int k = 0; k < matched.size(); ++k) {
+                    row.append(charAt[matched[k]]);
+                }
+            }
         }
+        
+        std::sort(row.begin(), row.end());
+        row.erase(std::unique(row.begin(), row.end()), row.end());
+    }
+    return positions;
+}
+
+bool FuzzyMatcher::searchTerm(const QString &queryLower, int maxResults, SearchControl *control,
+                              QVector<TopKSelector::ScoredEntry> &winners, bool &complete) const
+{
+    PreparedQuery prepared(queryLower);
+    const QByteArray &queryUtf8 = prepared.utf8;
+    const PathScorer pathScorer(queryUtf8);
+    
+    // Enough exact, prefix and substring hits outrank every fuzzier tier, so the posting
+    // lists answer the query without a scan
+    if (m_scoringMode == NameScoring) {
+        TopKSelector substringResults(maxResults);
+        if (searchSubstrings(prepared, substringResults)) {
+            winners = substringResults.sorted();
+            complete = false;
+            return true;
+        }
+        findTypos(prepared);
     }
     
-    return results;
+    // When the query extends an earlier one only that query's survivors need scoring
+    QVector<int> candidates;
+    const bool narrowed = narrowCandidates(queryLower, prepared, candidates);
+    
+    TopKSelector topResults(maxResults);
+    QVector<int> survivors;
+    const bool finished = scan(narrowed ? &candidates : nullptr, maxResults, control,
+                               [&](const int *candidateData, int begin, int end,
+                                   TopKSelector &target, QVector<int> &chunkSurvivors) {
+        if (m_scoringMode == PathScoring) {
+            scorePathBatch(prepared, pathScorer, candidateData, begin, end, target, chunkSurvivors);
+        } else {
+            scoreFileBatch(prepared, candidateData, begin, end, target, chunkSurvivors);
+        }
+    }, topResults, survivors);
+    
+    if (!finished) {
+        return false;
+    }
+    
+    pushNarrowingLevel(queryUtf8, survivors);
+    winners = topResults.sorted();
+    complete = survivors.size() <= maxResults;
+    return true;
 }
 
-void FuzzyMatcher::scoreFileBatch(const QString &queryLower, 
-                                  const QVector<FileEntry> &batch, 
-                                  QVector<QPair<QString, int>> &results,
-                                  std::mutex &resultsMutex) const
+bool FuzzyMatcher::searchPlan(const QueryPlan &plan, int maxResults, SearchControl *control,
+                              QVector<TopKSelector::ScoredEntry> &winners, bool &complete) const
 {
-    QVector<QPair<QString, int>> localResults;
-    localResults.reserve(batch.size() / 2);
+    const CompiledQuery compiled(plan, *this);
+    
+    // Text every match must hold in its file name limits the scan to the name's trigram hits
+    QVector<int> candidates;
+    const QByteArray required = plan.longestRequiredSubstring(m_scoringMode == PathScoring);
+    const bool narrowed = m_trigramIndexEnabled &&
+                          m_trigrams.candidates(required.constData(), required.size(), candidates);
+    
+    TopKSelector topResults(maxResults);
+    QVector<int> survivors;
+    const bool finished = scan(narrowed ? &candidates : nullptr, maxResults, control,
+                               [&](const int *candidateData, int begin, int end,
+                                   TopKSelector &target, QVector<int> &chunkSurvivors) {
+        scorePlanBatch(compiled, candidateData, begin, end, target, chunkSurvivors);
+    }, topResults, survivors);
     
-    for (const FileEntry &entry : batch) {
-        int score = calculateScore(queryLower, entry);
-        if (score > 0) {
-            localResults.append(qMakePair(entry.fullPath, score));
+    if (!finished) {
+        return false;
+    }
+    
+    // Predicates are not monotonic under typing, so compound queries leave the narrowing stack alone
+    winners = topResults.sorted();
+    complete = survivors.size() <= maxResults;
+    return true;
+}
+
+bool FuzzyMatcher::scan(const QVector<int> *candidates, int maxResults, SearchControl *control,
+                        const BatchScorer &scoreBatch,
+                        TopKSelector &topResults, QVector<int> &survivors) const
+{
+    const int *candidateData = candidates ? candidates->constData() : nullptr;
+    const int total = candidates ? candidates->size() : m_entries.size();
+    
+    // Workers score chunks of the shared arrays in place and never touch each other's buffers
+    const int chunkSize = 2048;
+    const int workers = RangeScheduler::workerCount(total, chunkSize);
+    
+    QVector<TopKSelector> workerResults(workers, TopKSelector(maxResults));
+    QVector<QVector<int>> workerSurvivors(workers);
+    
+    if (control) {
+        control->future.setProgressRange(0, total);
+    }
+    
+    RangeScheduler::run(total, workers, chunkSize, [&](int worker, int begin, int end) {
+        if (control && control->isCanceled()) {
+            return;
+        }
+        
+        // Asynchronous searches score each chunk on its own so it can join the preview
+        TopKSelector chunkResults(control ? maxResults : 0);
+        TopKSelector &target = control ? chunkResults : workerResults[worker];
+        
+        scoreBatch(candidateData, begin, end, target, workerSurvivors[worker]);
+        
+        if (control) {
+            workerResults[worker].merge(chunkResults);
+            publishPreview(control, chunkResults, end - begin);
         }
+    });
+    
+    // An abandoned scan saw only part of the candidates, so keep nothing from it
+    if (control && control->isCanceled()) {
+        return false;
     }
     
-    if (!localResults.isEmpty()) {
-        std::lock_guard<std::mutex> lock(resultsMutex);
-        results.append(localResults);
+    for (int worker = 0; worker < workers; ++worker) {
+        topResults.merge(workerResults[worker]);
+        survivors += workerSurvivors[worker];
     }
+    
+    std::sort(survivors.begin(), survivors.end());
+    return true;
 }
 
-int FuzzyMatcher::calculateScore(const QString &queryLower, const FileEntry &entry) const
+bool FuzzyMatcher::searchSubstrings(const PreparedQuery &query, TopKSelector &topResults) const
 {
-    if (queryLower.isEmpty()) {
-        return 1;
+    QVector<int> hits;
+    if (!m_trigramIndexEnabled ||
+        !m_trigrams.candidates(query.utf8.constData(), query.utf8.size(), hits) ||
+        hits.size() < topResults.capacity()) {
+        return false;
     }
+    countPrefilter(m_entries.size(), hits.size());
     
-    if (entry.lowerName == queryLower) {
-        return 1000;
+    const int chunkSize = 2048;
+    const int workers = RangeScheduler::workerCount(hits.size(), chunkSize);
+    
+    QVector<TopKSelector> workerResults(workers, TopKSelector(topResults.capacity()));
+    QVector<int> workerMatches(workers, 0);
+    
+    // Trigram hits are only candidates; the substring tiers of calculateScore() confirm them
+    RangeScheduler::run(hits.size(), workers, chunkSize, [&](int worker, int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            const int entry = hits.at(i);
+            if (m_entries.isRemoved(entry)) {
+                continue;
+            }
+            
+            const int score = calculateScore(query, entry);
+            if (score >= MIN_SUBSTRING_SCORE) {
+                workerResults[worker].push(entry, withUsageBoost(score, entry));
+                ++workerMatches[worker];
+            }
+        }
+    });
+    
+    int matches = 0;
+    for (int worker = 0; worker < workers; ++worker) {
+        topResults.merge(workerResults[worker]);
+        matches += workerMatches[worker];
+    }
+    return matches >= topResults.capacity();
+}
+
+// Bit i set when entry block + i (or candidates[block + i]) is one of the query's typo matches.
+// Both lists ascend, so each block takes a binary search and a merge.
+static quint64 typoEntries(const QVector<QPair<int, int>> &typoScores, const int *candidates, int block, int blockEnd)
+{
+    if (typoScores.isEmpty()) {
+        return 0;
     }
     
-    if (entry.lowerName.startsWith(queryLower)) {
-        return 800;
+    const int first = candidates ? candidates[block] : block;
+    const int last = candidates ? candidates[blockEnd - 1] : blockEnd - 1;
+    auto typo = std::lower_bound(typoScores.constBegin(), typoScores.constEnd(), first,
+                                 [](const QPair<int, int> &t, int slot) { return t.first < slot; });
+    
+    quint64 bits = 0;
+    int i = block;
+    for (; typo != typoScores.constEnd() && typo->first <= last; ++typo) {
+        if (candidates) {
+            while (candidates[i] < typo->first) {
+                ++i;
+            }
+            if (candidates[i] != typo->first) {
+                continue;
+            }
+        } else {
+            i = typo->first;
+        }
+        bits |= quint64(1) << (i - block);
     }
+    return bits;
+}
+
+void FuzzyMatcher::scoreFileBatch(const PreparedQuery &query,
+                                  const int *candidates,
+                                  int begin,
+                                  int end,
+                                  TopKSelector &topResults,
+                                  QVector<int> &survivors) const
+{
+    const quint64 queryMask = EntryStore::characterMaskOf(query.utf8.constData(), query.utf8.size());
+    const quint64 *masks = m_entries.characterMasks();
+    const quint8 *flags = m_entries.flagData();
+    int plausibleCount = 0;
     
-    if (entry.lowerName.contains(queryLower)) {
-        return 600;
+    for (int block = begin; block < end; block += 64) {
+        const int blockEnd = qMin(block + 64, end);
+        
+        // Branch-free AND-compare over the contiguous arrays, one candidate bit per entry.
+        // A typo may replace a query character, so typo matches bypass the mask; they are
+        // looked up live.
+        quint64 plausibleBits = typoEntries(query.typoScores, candidates, block, blockEnd);
+        for (int i = block; i < blockEnd; ++i) {
+            const int entry = candidates ? candidates[i] : i;
+            const bool live = !(flags[entry] & EntryStore::RemovedFlag);
+            const bool plausible = live & ((masks[entry] & queryMask) == queryMask);
+            plausibleBits |= quint64(plausible) << (i - block);
+        }
+        plausibleCount += qPopulationCount(plausibleBits);
+        
+        while (plausibleBits) {
+            const int i = block + qCountTrailingZeroBits(plausibleBits);
+            const int entry = candidates ? candidates[i] : i;
+            plausibleBits &= plausibleBits - 1;
+            
+            const int score = calculateScore(query, entry);
+            if (score > 0) {
+                topResults.push(entry, withUsageBoost(score, entry));
+                survivors.append(entry);
+            }
+        }
+    }
+    countPrefilter(end - begin, plausibleCount);
+}
+
+static int withLengthTieBreak(int alignment, int pathLength)
+{
+    // Equal alignments prefer the shorter path
+    return alignment * PATH_LENGTH_RANGE + (PATH_LENGTH_RANGE - 1 - qMin(pathLength, PATH_LENGTH_RANGE - 1));
+}
+
+int FuzzyMatcher::alignPath(const PathScorer &pathScorer, int entry) const
+{
+    // Paths are stored as directory nodes, so the aligned bytes are put back together first.
+    // ASCII paths keep their case for the camelCase bonus and the scorer folds them itself;
+    // any other path is aligned on the key it was given when indexed.
+    QVarLengthArray<char, 256> pathBuffer;
+    int nameOffset;
+    const bool ascii = m_entries.flags(entry) & EntryStore::AsciiFlag;
+    if (ascii) {
+        pathBuffer.resize(m_entries.pathLength(entry));
+        nameOffset = pathBuffer.size() - m_entries.nameLength(entry);
+        m_entries.copyPath(entry, pathBuffer.data());
+    } else {
+        pathBuffer.resize(m_entries.foldedPathLength(entry));
+        nameOffset = pathBuffer.size() - m_entries.lowerNameLength(entry);
+        m_entries.copyFoldedPath(entry, pathBuffer.data());
+    }
+    
+    const int root = rootPrefixLength(entry, !ascii);
+    return pathScorer.score(pathBuffer.constData() + root, pathBuffer.size() - root, nameOffset - root);
+}
+
+int FuzzyMatcher::rootPrefixLength(int entry, bool folded) const
+{
+    // The entry's directory is the root or below it; its bytes are compared as spelled, and a
+    // folded path starts with the root's key
+    const int directory = m_entries.directoryOf(entry);
+    if (m_pathRoot.isEmpty() || directory == EntryStore::NO_DIRECTORY) {
+        return 0;
+    }
+    
+    const EntryStore::DirectoryNode &node = m_entries.directoryNodes()[directory];
+    const char *path = m_entries.directoryArena() + node.pathOffset;
+    const int rootLength = m_pathRootUtf8.size();
+    if (int(node.pathLength) < rootLength || memcmp(path, m_pathRootUtf8.constData(), rootLength) != 0 ||
+        (int(node.pathLength) > rootLength && path[rootLength] != '/')) {
+        return 0;
+    }
+    return (folded ? m_pathRootKeyLength : rootLength) + 1;
+}
+
+quint64 FuzzyMatcher::rootedPathMask(int entry) const
+{
+    const bool ascii = m_entries.flags(entry) & EntryStore::AsciiFlag;
+    const int root = rootPrefixLength(entry, !ascii);
+    if (root == 0) {
+        return m_entries.pathMask(entry);
+    }
+    
+    // Masked over the bytes alignPath() aligns, like the store's own path masks
+    QVarLengthArray<char, 256> pathBuffer;
+    if (ascii) {
+        pathBuffer.resize(m_entries.pathLength(entry));
+        m_entries.copyPath(entry, pathBuffer.data());
+    } else {
+        pathBuffer.resize(m_entries.foldedPathLength(entry));
+        m_entries.copyFoldedPath(entry, pathBuffer.data());
+    }
+    return EntryStore::foldedCharacterMaskOf(pathBuffer.constData() + root, pathBuffer.size() - root);
+}
+
+void FuzzyMatcher::rebuildPathMasks()
+{
+    if (m_pathRoot.isEmpty()) {
+        m_rootedPathMasks.clear();
+        return;
     }
     
-    if (queryLower.length() <= 5 && queryLower.length() >= 2) {
-        QString pattern = entry.lowerName;
-        pattern.replace(QRegularExpression("[^a-zA-Z0-9]"), " ");
-        QStringList words = pattern.split(" ", Qt::SkipEmptyParts);
+    m_rootedPathMasks.resize(m_entries.size());
+    quint64 *masks = m_rootedPathMasks.data();
+    const int chunkSize = 16384;
+    RangeScheduler::forEach((m_entries.size() + chunkSize - 1) / chunkSize, Executor::Background,
+                            [this, masks, chunkSize](int chunk) {
+        const int end = qMin(m_entries.size(), (chunk + 1) * chunkSize);
+        for (int slot = chunk * chunkSize; slot < end; ++slot) {
+            masks[slot] = rootedPathMask(slot);
+        }
+    });
+}
+
+const quint64 *FuzzyMatcher::pathMasks() const
+{
+    return m_pathRoot.isEmpty() ? m_entries.pathMasks() : m_rootedPathMasks.constData();
+}
+
+int FuzzyMatcher::withUsageBoost(int score, int entry) const
+{
+    const int id = m_entries.entryId(entry);
+    if (id >= m_usageBoosts.size()) {
+        return score;
+    }
+    
+    // A full boost is worth a couple of matched characters in a path alignment; half will do
+    const int boost = m_usageBoosts.at(id);
+    return m_scoringMode == PathScoring ? score + boost / 2 : score + boost;
+}
+
+int FuzzyMatcher::scorePlan(const CompiledQuery &compiled, int entry) const
+{
+    const char *name = m_entries.lowerName(entry);
+    const int nameLength = m_entries.lowerNameLength(entry);
+    const QueryPlan &plan = compiled.plan;
+    
+    if (m_scoringMode == NameScoring) {
+        if (!plan.accepts(name, nameLength, name, nameLength)) {
+            return 0;
+        }
+    } else if (m_entries.flags(entry) & EntryStore::AsciiFlag) {
+        // Restrictions see the path the terms are aligned on, without the root
+        QVarLengthArray<char, 256> path(m_entries.pathLength(entry));
+        m_entries.copyPath(entry, path.data());
+        const int root = rootPrefixLength(entry, false);
+        if (!plan.accepts(path.constData() + root, path.size() - root, name, nameLength)) {
+            return 0;
+        }
+    } else if (!plan.predicates().isEmpty()) {
+        QVarLengthArray<char, 256> folded(m_entries.foldedPathLength(entry));
+        m_entries.copyFoldedPath(entry, folded.data());
+        const int root = rootPrefixLength(entry, true);
+        if (!plan.accepts(folded.constData() + root, folded.size() - root, name, nameLength)) {
+            return 0;
+        }
+    }
+    
+    // Terms are only scored once every predicate has passed, most selective first
+    int total = 0;
+    for (size_t i = 0; i < compiled.terms.size(); ++i) {
+        const PreparedQuery &term = compiled.terms[i];
+        int score;
+        if (m_scoringMode == NameScoring) {
+            // A name missing a term character can only match that term through a typo
+            const quint64 mask = compiled.termMasks[i];
+            score = (m_entries.characterMask(entry) & mask) == mask ? calculateScore(term, entry)
+                                                                    : typoScore(term, entry);
+        } else {
+            score = alignPath(compiled.pathScorers[i], entry);
+        }
         
-        if (words.size() >= queryLower.length()) {
-            bool match = true;
-            for (int i = 0; i < queryLower.length() && i < words.size(); ++i) {
-                if (words[i].isEmpty() || words[i][0] != queryLower[i]) {
-                    match = false;
-                    break;
-                }
+        if (score <= 0) {
+            return 0;
+        }
+        total += score;
+    }
+    
+    total = withUsageBoost(qMax(total, 1), entry);
+    return m_scoringMode == PathScoring ? withLengthTieBreak(total, m_entries.pathLength(entry) - rootPrefixLength(entry, false))
+                                        : total;
+}
+
+quint64 FuzzyMatcher::plausibleEntries(const CompiledQuery &compiled, const int *candidates, int block, int blockEnd) const
+{
+    const quint64 requiredMask = compiled.requiredMask;
+    const quint64 *masks = m_scoringMode == PathScoring ? pathMasks() : m_entries.characterMasks();
+    const quint8 *flags = m_entries.flagData();
+    
+    // Branch-free over the block, like scoreFileBatch()
+    quint64 plausibleBits = 0;
+    for (int i = block; i < blockEnd; ++i) {
+        const int entry = candidates ? candidates[i] : i;
+        const bool plausible = !(flags[entry] & EntryStore::RemovedFlag) &
+                               ((masks[entry] & requiredMask) == requiredMask);
+        plausibleBits |= quint64(plausible) << (i - block);
+    }
+    
+    // In name mode each term's characters must be present too, unless the name holds a typo of it
+    if (m_scoringMode == NameScoring) {
+        for (size_t t = 0; t < compiled.terms.size() && plausibleBits; ++t) {
+            const quint64 termMask = compiled.termMasks[t];
+            quint64 termBits = typoEntries(compiled.terms[t].typoScores, candidates, block, blockEnd);
+            for (int i = block; i < blockEnd; ++i) {
+                const int entry = candidates ? candidates[i] : i;
+                termBits |= quint64((masks[entry] & termMask) == termMask) << (i - block);
             }
+            plausibleBits &= termBits;
+        }
+    }
+    return plausibleBits;
+}
+
+void FuzzyMatcher::scorePlanBatch(const CompiledQuery &compiled,
+                                  const int *candidates,
+                                  int begin,
+                                  int end,
+                                  TopKSelector &topResults,
+                                  QVector<int> &survivors) const
+{
+    int plausibleCount = 0;
+    for (int block = begin; block < end; block += 64) {
+        const int blockEnd = qMin(block + 64, end);
+        quint64 plausibleBits = plausibleEntries(compiled, candidates, block, blockEnd);
+        plausibleCount += qPopulationCount(plausibleBits);
+        
+        while (plausibleBits) {
+            const int i = block + qCountTrailingZeroBits(plausibleBits);
+            const int entry = candidates ? candidates[i] : i;
+            plausibleBits &= plausibleBits - 1;
             
-            if (match) {
-                return 550;
+            const int score = scorePlan(compiled, entry);
+            if (score > 0) {
+                topResults.push(entry, score);
+                survivors.append(entry);
             }
         }
     }
+    countPrefilter(end - begin, plausibleCount);
+}
+
+void FuzzyMatcher::scorePathBatch(const PreparedQuery &query,
+                                  const PathScorer &pathScorer,
+                                  const int *candidates,
+                                  int begin,
+                                  int end,
+                                  TopKSelector &topResults,
+                                  QVector<int> &survivors) const
+{
+    const quint64 queryMask = EntryStore::foldedCharacterMaskOf(query.utf8.constData(), query.utf8.size());
+    const quint64 *masks = pathMasks();
+    const quint8 *flags = m_entries.flagData();
+    int plausibleCount = 0;
     
-    if (queryLower.length() > 2 || entry.lowerName.length() < 10) {
-        int distance = levenshteinDistance(queryLower, entry.lowerName);
+    for (int block = begin; block < end; block += 64) {
+        const int blockEnd = qMin(block + 64, end);
+        
+        quint64 plausibleBits = 0;
+        for (int i = block; i < blockEnd; ++i) {
+            const int entry = candidates ? candidates[i] : i;
+            const bool plausible = !(flags[entry] & EntryStore::RemovedFlag) & ((masks[entry] & queryMask) == queryMask);
+            plausibleBits |= quint64(plausible) << (i - block);
+        }
+        plausibleCount += qPopulationCount(plausibleBits);
         
-        if (distance <= queryLower.length() * 2) {
-            int levenshteinScore = 500 - distance * 10;
+        while (plausibleBits) {
+            const int i = block + qCountTrailingZeroBits(plausibleBits);
+            const int entry = candidates ? candidates[i] : i;
+            plausibleBits &= plausibleBits - 1;
             
-            return qMax(1, levenshteinScore);
+            const int score = alignPath(pathScorer, entry);
+            if (score > 0) {
+                const int pathLength = m_entries.pathLength(entry) - rootPrefixLength(entry, false);
+                topResults.push(entry, withLengthTieBreak(withUsageBoost(score, entry), pathLength));
+                survivors.append(entry);
+            }
+        }
+    }
+    countPrefilter(end - begin, plausibleCount);
+}
+
+// Character policies the name kernel is instantiated with. ASCII names are scored on their
+// bytes with memchr/memcmp; any other name is decoded to code points first.
+struct AsciiChars {
+    typedef char Unit;
+    
+    static int indexOf(const char *s, int length, char c, int from)
+    {
+        if (from >= length) {
+            return -1;
+        }
+        
+        const void *found = memchr(s + from, c, length - from);
+        return found ? static_cast<int>(static_cast<const char *>(found) - s) : -1;
+    }
+    
+    static bool equal(const char *a, const char *b, int length)
+    {
+        return memcmp(a, b, length) == 0;
+    }
+};
+
+struct UnicodeChars {
+    typedef uint Unit;
+    
+    static int indexOf(const uint *s, int length, uint c, int from)
+    {
+        for (int i = from; i < length; ++i) {
+            if (s[i] == c) {
+                return i;
+            }
         }
+        return -1;
     }
     
+    static bool equal(const uint *a, const uint *b, int length)
+    {
+        return std::equal(a, a + length, b);
+    }
+};
+
+template <typename Chars, typename Unit>
+static int indexOfUnits(const Unit *s, int length, const Unit *needle, int needleLength)
+{
+    int from = 0;
+    while (from + needleLength <= length) {
+        int index = Chars::indexOf(s, length - needleLength + 1, needle[0], from);
+        if (index == -1) {
+            return -1;
+        }
+        if (Chars::equal(s + index, needle, needleLength)) {
+            return index;
+        }
+        from = index + 1;
+    }
+    return -1;
+}
+
+// Decodes the UTF-8 that QString::toUtf8() produced; returns the number of code points
+static int decodeUtf8(const char *data, int length, uint *out)
+{
+    int count = 0;
+    for (int i = 0; i < length; ++count) {
+        const uchar lead = data[i];
+        int extra = lead >= 0xf0 ? 3 : lead >= 0xe0 ? 2 : lead >= 0xc0 ? 1 : 0;
+        uint c = extra ? lead & (0x3f >> extra) : lead;
+        for (++i; extra > 0 && i < length; --extra, ++i) {
+            c = (c << 6) | (static_cast<uchar>(data[i]) & 0x3f);
+        }
+        out[count] = c;
+    }
+    return count;
+}
+
+template <typename Chars>
+static int scoreName(const typename Chars::Unit *query, int queryLength,
+                     const typename Chars::Unit *name, int nameLength,
+                     quint64 wordInitials)
+{
+    if (queryLength == 0) {
+        return 1;
+    }
+    
+    if (nameLength == queryLength && Chars::equal(name, query, queryLength)) {
+        return 1000;
+    }
+    
+    if (nameLength >= queryLength && Chars::equal(name, query, queryLength)) {
+        return 800;
+    }
+    
+    if (indexOfUnits<Chars>(name, nameLength, query, queryLength) != -1) {
+        return 600;
+    }
+    
+    if (queryLength <= 5 && queryLength >= 2 && int(wordInitials >> 56) >= queryLength) {
+        // Compare against the first letters of the leading words, taken at index time. Word
+        // starts are ASCII letters or digits, so any other query character rules this out.
+        quint64 acronym = 0;
+        bool ascii = true;
+        for (int i = 0; i < queryLength; ++i) {
+            const uint c = static_cast<uint>(query[i]);
+            ascii &= c < 0x80;
+            acronym |= quint64(c & 0x7f) << (i * 8);
+        }
+        
+        const quint64 mask = (quint64(1) << (queryLength * 8)) - 1;
+        if (ascii && (wordInitials & mask) == acronym) {
+            return 550;
+        }
+    }
+    
+    // The typo tier comes next; its matches are found by TypoIndex, see calculateScore()
     int lastIndex = -1;
     bool allCharsFound = true;
     
-    for (QChar c : queryLower) {
-        int index = entry.lowerName.indexOf(c, lastIndex + 1);
+    for (int i = 0; i < queryLength; ++i) {
+        int index = Chars::indexOf(name, nameLength, query[i], lastIndex + 1);
         if (index == -1) {
             allCharsFound = false;
             break;
@@ -181,7 +1403,7 @@ int FuzzyMatcher::calculateScore(const QString &queryLower, const FileEntry &ent
     }
     
     if (allCharsFound) {
-        int matchLength = lastIndex + 1 - entry.lowerName.indexOf(queryLower[0]);
+        int matchLength = lastIndex + 1 - Chars::indexOf(name, nameLength, query[0], 0);
         int proximityScore = 100 - qMin(90, matchLength);
         return proximityScore;
     }
@@ -189,46 +1411,77 @@ int FuzzyMatcher::calculateScore(const QString &queryLower, const FileEntry &ent
     return 0;
 }
 
-int FuzzyMatcher::levenshteinDistance(const QString &s1, const QString &s2) const
+int FuzzyMatcher::calculateScore(const PreparedQuery &query, int entry) const
 {
-    const int len1 = s1.length();
-    const int len2 = s2.length();
+    const char *name = m_entries.lowerName(entry);
+    const int nameLength = m_entries.lowerNameLength(entry);
+    const quint64 wordInitials = m_entries.wordInitials(entry);
     
-    if (len1 == 0) return len2;
-    if (len2 == 0) return len1;
-    
-    if (qAbs(len1 - len2) > len1) {
-        return len2;
+    // The kind of the name was recorded at load time, so this is the only per-entry decision
+    int score;
+    if (query.ascii && (m_entries.flags(entry) & EntryStore::AsciiFlag)) {
+        score = scoreName<AsciiChars>(query.utf8.constData(), query.utf8.size(), name, nameLength,
+                                      wordInitials);
+    } else {
+        QVarLengthArray<uint, 256> units(nameLength);
+        const int unitCount = decodeUtf8(name, nameLength, units.data());
+        score = scoreName<UnicodeChars>(query.codePoints.constData(), query.codePoints.size(),
+                                        units.constData(), unitCount, wordInitials);
     }
+    return score < MAX_TYPO_SCORE ? qMax(score, typoScore(query, entry)) : score;
+}
+
+void FuzzyMatcher::findTypos(PreparedQuery &query) const
+{
+    QVector<TypoIndex::Match> matches;
+    m_typos.lookup(query.utf8.constData(), query.utf8.size(), matches);
     
-    QVector<int> prev(len2 + 1);
-    QVector<int> curr(len2 + 1);
-    
-    for (int i = 0; i <= len2; i++) {
-        prev[i] = i;
+    // Between the acronym and subsequence tiers; the closer the misspelled word comes to the
+    // whole name, the higher
+    query.typoScores.clear();
+    query.typoScores.reserve(matches.size());
+    for (const TypoIndex::Match &match : matches) {
+        if (!m_entries.isRemoved(match.slot)) {
+            const int rest = m_entries.lowerNameLength(match.slot) - match.wordLength;
+            query.typoScores.append(qMakePair(match.slot, MAX_TYPO_SCORE - qMin(rest, 99)));
+        }
     }
+}
+
+int FuzzyMatcher::typoScore(const PreparedQuery &query, int entry) const
+{
+    const auto typo = std::lower_bound(query.typoScores.constBegin(), query.typoScores.constEnd(), entry,
+                                       [](const QPair<int, int> &t, int slot) { return t.first < slot; });
+    return typo != query.typoScores.constEnd() && typo->first == entry ? typo->second : 0;
+}
+
+FuzzyMatcher::CompiledQuery::CompiledQuery(const QueryPlan &queryPlan, const FuzzyMatcher &matcher)
+    : plan(queryPlan)
+{
+    const ScoringMode mode = matcher.m_scoringMode;
+    QStringList termTexts = plan.terms();
+    std::stable_sort(termTexts.begin(), termTexts.end(),
+                     [](const QString &a, const QString &b) { return a.size() > b.size(); });
     
-    for (int i = 0; i < len1; i++) {
-        curr[0] = i + 1;
-        
-        bool allBig = true;
-        const int threshold = len1;
-        
-        for (int j = 0; j < len2; j++) {
-            int cost = (s1[i] == s2[j]) ? 0 : 1;
-            curr[j + 1] = qMin(qMin(curr[j] + 1, prev[j + 1] + 1), prev[j] + cost);
-            
-            if (curr[j + 1] < threshold) {
-                allBig = false;
-            }
-        }
-        
-        if (allBig) {
-            return threshold;
+    // Every predicate's text is part of the path, and in path mode so is every term
+    QByteArray required = plan.requiredText();
+    for (const QString &text : termTexts) {
+        terms.emplace_back(text);
+        pathScorers.emplace_back(terms.back().utf8);
+        termMasks.push_back(EntryStore::characterMaskOf(terms.back().utf8.constData(), terms.back().utf8.size()));
+        if (mode == PathScoring) {
+            required += terms.back().utf8;
+        } else {
+            matcher.findTypos(terms.back());
         }
-        
-        prev = curr;
     }
-    
-    return prev[len2];
-} 
\ No newline at end of file
+    requiredMask = mode == PathScoring ? EntryStore::foldedCharacterMaskOf(required.constData(), required.size())
+                                       : EntryStore::characterMaskOf(required.constData(), required.size());
+}
+
+FuzzyMatcher::PreparedQuery::PreparedQuery(const QString &queryLower)
+    : utf8(queryLower.toUtf8())
+    , codePoints(queryLower.toUcs4())
+    , ascii(utf8.size() == codePoints.size())
+{
+}
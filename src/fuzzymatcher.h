@@ -6,42 +6,231 @@
 #include <QVector>
 #include <QPair>
 #include <QHash>
-#include <QFileInfo>
-#include <QtConcurrent>
+#include <QSet>
+#include <QByteArray>
+#include <QSharedPointer>
+#include <QFuture>
 #include <algorithm>
 #include <functional>
 #include <unordered_map>
 #include <mutex>
+#include <vector>
+#include "entrystore.h"
+#include "topkselector.h"
+#include "rangescheduler.h"
+#include "trigramindex.h"
+#include "typoindex.h"
+#include "pathscorer.h"
+#include "querycache.h"
+#include "queryplan.h"
 
-struct FileEntry {
-    QString fullPath;
-    QString fileName;
-    QString lowerName;  // Pre-computed lowercase name for case-insensitive matching
-};
+class IndexSnapshot;
 
 class FuzzyMatcher
 {
 public:
+    enum ScoringMode {
+        NameScoring,  // Tiered exact/prefix/substring/acronym/typo/subsequence checks on the file name
+        PathScoring   // PathScorer alignment over the full path
+    };
+    
     FuzzyMatcher();
     
     void setCollection(const QStringList &collection);
+    void setCollection(const QSharedPointer<const IndexSnapshot> &snapshot);
+    
+    // Apply filesystem changes in place; ids stay stable across removals and compaction.
+    // Like setCollection(), these must not run concurrently with search().
+    QVector<int> addPaths(const QStringList &paths);
+    int removePaths(const QStringList &paths);
+    bool renamePath(const QString &from, const QString &to);
+    
+    void setScoringMode(ScoringMode mode);
+    ScoringMode scoringMode() const { return m_scoringMode; }
+    
+    // In path mode, paths below root are aligned, masked and highlighted without the root and
+    // the '/' after it, so a query never matches the prefix every entry shares. Paths outside
+    // it are used whole, as they all are while the root is empty (the default). Like
+    // setCollection(), this must not run concurrently with search().
+    void setPathRoot(const QString &root);
+    QString pathRoot() const { return m_pathRoot; }
+    
+    // Upper bound on the bytes kept by the result cache; QueryCache::DEFAULT_BUDGET by default
+    void setCacheBudget(qint64 bytes);
+    qint64 cacheBudget() const;
+    
+    // Substring lookups through trigram posting lists; on by default
+    void setTrigramIndexEnabled(bool enabled);
+    bool isTrigramIndexEnabled() const { return m_trigramIndexEnabled; }
+    
+    // Usage weights (see FrecencyStore) lift frequently and recently picked paths within the
+    // matches of a query; they never make a non-matching entry match. setCollection() drops
+    // them. Like setCollection(), these must not run concurrently with search().
+    void setUsageWeights(const QHash<QString, double> &weights);
+    void setUsageWeight(const QString &path, double weight);
+    
+    // Largest boost in name-score points; below the gap between the acronym and substring tiers
+    static const int MAX_USAGE_BOOST = 40;
+    
+    const EntryStore &entries() const { return m_entries; }
+    
+    // The query may combine several terms with restrictions such as .ext or !exclude; see QueryPlan.
+    // Queries and entries are compared by their SearchKey, so case and accents do not matter.
+    // A non-empty extension (without the dot) restricts the results like a .ext token would,
+    // without being parsed from the query text.
+    QStringList search(const QString &query, int maxResults = 10, const QString &extension = QString()) const;
+    
+    // Answers each query as search() would, but scores all of them in one pass over the
+    // entries: every block of entries is visited once and scored against each query while
+    // it is in cache, so thousands of lookups cost far less than thousands of scans
+    QVector<QStringList> searchBatch(const QStringList &queries, int maxResults = 10) const;
+    
+    // Ranks only the entries anywhere below directory, given as the entries spell it. The
+    // subtree is gathered from the directory table, so a narrow scope scores a few entries
+    // instead of all of them; scoped answers bypass the result cache.
+    QStringList searchWithin(const QString &directory, const QString &query, int maxResults = 10) const;
+    
+    // For each of paths, as search() returns them, the indices of the characters the fuzzy
+    // terms of query line up with, ascending. Terms are aligned the way the scoring mode
+    // scores them. The query is compiled once for the whole list, so callers pass just the
+    // rows they show; the scoring pass itself never tracks positions.
+    QVector<QVector<int>> matchPositions(const QString &query, const QStringList &paths) const;
+    
+    struct SearchUpdate {
+        QStringList results;  // Best matches so far, best first
+        bool complete = false;
+    };
+    
+    // Runs search() on the thread pool. While chunks complete, the best previewSize matches
+    // found so far are reported as incomplete updates (at most one per PREVIEW_INTERVAL_MS);
+    // the last result holds the full answer. Cancelling the future stops the scan between
+    // chunks. The matcher must not be modified until the future has finished.
+    QFuture<SearchUpdate> searchAsync(const QString &query, int maxResults = 10, int previewSize = 0,
+                                      const QString &extension = QString()) const;
     
-    QStringList search(const QString &query, int maxResults = 10) const;
+    static const int PREVIEW_INTERVAL_MS = 16;
 
 private:
-    int calculateScore(const QString &queryLower, const FileEntry &entry) const;
+    struct SearchControl;
+    
+    // The lowercased query in the units of both name kernels, prepared once per search.
+    // ASCII entries meet an ASCII query in the byte kernel; every other pairing is scored on
+    // code points so a non-ASCII character counts as one character, not two to four bytes.
+    struct PreparedQuery {
+        explicit PreparedQuery(const QString &queryLower);
+        
+        QByteArray utf8;
+        QVector<uint> codePoints;
+        bool ascii;
+        
+        // Typo-tier score of every entry with a word one typo from the query, ascending by
+        // slot; filled by findTypos() in name mode
+        QVector<QPair<int, int>> typoScores;
+    };
+    
+    // A compound query: the plan's predicates plus one prepared query per fuzzy term
+    struct CompiledQuery {
+        CompiledQuery(const QueryPlan &queryPlan, const FuzzyMatcher &matcher);
+        
+        QueryPlan plan;
+        std::vector<PreparedQuery> terms;  // Longest first
+        std::vector<PathScorer> pathScorers;
+        std::vector<quint64> termMasks;
+        quint64 requiredMask;  // Characters any accepted entry's mask must hold
+    };
+    
+    // Scores entries [begin, end) of the candidates (or of every slot when candidates is null)
+    typedef std::function<void(const int *candidates, int begin, int end,
+                               TopKSelector &topResults, QVector<int> &survivors)> BatchScorer;
+    
+    struct NarrowingLevel {
+        QByteArray query;
+        QVector<int> survivors;  // Sorted indices of every entry that scored above zero
+    };
+    
+    QStringList runSearch(const QString &query, const QString &extension, int maxResults, SearchControl *control) const;
+    QStringList firstEntries(int maxResults) const;
+    bool searchIndexed(const QueryPlan &plan, int maxResults, QStringList &results) const;
+    bool lookupCachedResults(const QString &queryLower, int maxResults, QStringList &results) const;
+    QStringList storeResults(const QString &queryLower, const QVector<TopKSelector::ScoredEntry> &winners,
+                             bool complete) const;
+    bool searchTerm(const QString &queryLower, int maxResults, SearchControl *control,
+                    QVector<TopKSelector::ScoredEntry> &winners, bool &complete) const;
+    bool searchPlan(const QueryPlan &plan, int maxResults, SearchControl *control,
+                    QVector<TopKSelector::ScoredEntry> &winners, bool &complete) const;
+    bool scan(const QVector<int> *candidates, int maxResults, SearchControl *control,
+              const BatchScorer &scoreBatch,
+              TopKSelector &topResults, QVector<int> &survivors) const;
+    void publishPreview(SearchControl *control, const TopKSelector &chunkResults, int scored) const;
+    
+    void addToIndexes(int slot);
+    void rebuildTrigramIndex();
+    void compactIfSparse();
+    void dropFromCachedResults(const QSet<int> &ids);
+    void mergeIntoCachedResults(const QVector<int> &addedSlots);
+    bool narrowCandidates(const QString &query, const PreparedQuery &prepared, QVector<int> &candidates) const;
+    void pushNarrowingLevel(const QByteArray &queryLower, const QVector<int> &survivors) const;
+    
+    bool searchSubstrings(const PreparedQuery &query, TopKSelector &topResults) const;
+    
+    void findTypos(PreparedQuery &query) const;
+    int typoScore(const PreparedQuery &query, int entry) const;
+    int calculateScore(const PreparedQuery &query, int entry) const;
+    int alignPath(const PathScorer &pathScorer, int entry) const;
+    int rootPrefixLength(int entry, bool folded) const;
+    quint64 rootedPathMask(int entry) const;
+    void rebuildPathMasks();
+    const quint64 *pathMasks() const;
+    int scorePlan(const CompiledQuery &compiled, int entry) const;
+    int withUsageBoost(int score, int entry) const;
+    
+    void scoreFileBatch(const PreparedQuery &query,
+                        const int *candidates,
+                        int begin,
+                        int end,
+                        TopKSelector &topResults,
+                        QVector<int> &survivors) const;
+    
+    // Bit i set when entry block + i (or candidates[block + i]) is live and passes the mask checks.
+    // Candidates must be ascending, so the query's typo matches can be merged in.
+    quint64 plausibleEntries(const CompiledQuery &compiled, const int *candidates, int block, int blockEnd) const;
+    
+    void scorePlanBatch(const CompiledQuery &compiled,
+                        const int *candidates,
+                        int begin,
+                        int end,
+                        TopKSelector &topResults,
+                        QVector<int> &survivors) const;
+    
+    void scorePathBatch(const PreparedQuery &query,
+                        const PathScorer &pathScorer,
+                        const int *candidates,
+                        int begin,
+                        int end,
+                        TopKSelector &topResults,
+                        QVector<int> &survivors) const;
+    
+    EntryStore m_entries;
+    
+    ScoringMode m_scoringMode;
+    
+    QString m_pathRoot;
+    QByteArray m_pathRootUtf8;
+    int m_pathRootKeyLength;  // Bytes of the root's SearchKey
+    QVector<quint64> m_rootedPathMasks;  // Path masks without the root; empty while there is none
     
-    int levenshteinDistance(const QString &s1, const QString &s2) const;
+    TrigramIndex m_trigrams;
+    bool m_trigramIndexEnabled;
     
-    void scoreFileBatch(const QString &queryLower, 
-                        const QVector<FileEntry> &batch, 
-                        QVector<QPair<QString, int>> &results,
-                        std::mutex &resultsMutex) const;
+    // Finds the entries the typo tier accepts without scoring the others
+    TypoIndex m_typos;
     
-    QVector<FileEntry> m_entries;
+    // Boost per entry id; empty when no usage weights are set
+    QVector<quint8> m_usageBoosts;
     
-    mutable QHash<QString, QStringList> m_queryCache;
+    mutable QueryCache m_queryCache;
+    mutable QVector<NarrowingLevel> m_narrowingStack;
     mutable std::mutex m_cacheMutex;
 };
 
-#endif // FUZZYMATCHER_H 
\ No newline at end of file
+#endif // FUZZYMATCHER_H
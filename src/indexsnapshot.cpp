@@ -0,0 +1,333 @@
+#include "indexsnapshot.h"
+#include "entrystore.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <cstring>
+#include <limits>
+
+static const char SNAPSHOT_MAGIC[4] = {'E', 'Z', 'F', 'I'};
+static const quint32 SNAPSHOT_VERSION = 7;
+static const quint32 SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+struct IndexSnapshot::SnapshotHeader {
+    char magic[4];
+    quint32 version;
+    quint32 byteOrder;
+    quint32 entryCount;
+    quint32 rootSize;
+    quint32 nameArenaSize;
+    quint32 lowerArenaSize;
+    quint32 directoryCount;
+    quint32 directoryArenaSize;
+    quint32 reserved;
+    qint64 createdMSecs;
+};
+
+struct SnapshotLayout {
+    qint64 root;
+    qint64 nameOffsets;
+    qint64 lowerOffsets;
+    qint64 directories;
+    qint64 charMasks;
+    qint64 pathMasks;
+    qint64 wordInitials;
+    qint64 flags;
+    qint64 directoryNodes;
+    qint64 nameArena;
+    qint64 lowerArena;
+    qint64 directoryArena;
+    qint64 total;
+};
+
+static qint64 align8(qint64 value)
+{
+    return (value + 7) & ~qint64(7);
+}
+
+static SnapshotLayout computeLayout(qint64 headerSize, quint32 count, quint32 rootSize,
+                                    quint32 nameArenaSize, quint32 lowerArenaSize,
+                                    quint32 directoryCount, quint32 directoryArenaSize)
+{
+    SnapshotLayout layout;
+    layout.root = align8(headerSize);
+    layout.nameOffsets = align8(layout.root + rootSize);
+    layout.lowerOffsets = align8(layout.nameOffsets + qint64(count + 1) * sizeof(quint32));
+    layout.directories = align8(layout.lowerOffsets + qint64(count + 1) * sizeof(quint32));
+    layout.charMasks = align8(layout.directories + qint64(count) * sizeof(quint32));
+    layout.pathMasks = align8(layout.charMasks + qint64(count) * sizeof(quint64));
+    layout.wordInitials = align8(layout.pathMasks + qint64(count) * sizeof(quint64));
+    layout.flags = align8(layout.wordInitials + qint64(count) * sizeof(quint64));
+    layout.directoryNodes = align8(layout.flags + count);
+    layout.nameArena = align8(layout.directoryNodes +
+                              qint64(directoryCount) * sizeof(EntryStore::DirectoryNode));
+    layout.lowerArena = align8(layout.nameArena + nameArenaSize);
+    layout.directoryArena = align8(layout.lowerArena + lowerArenaSize);
+    layout.total = layout.directoryArena + directoryArenaSize;
+    return layout;
+}
+
+static bool writeSection(QSaveFile &file, qint64 offset, const char *data, qint64 size)
+{
+    static const char padding[8] = {};
+    const qint64 gap = offset - file.pos();
+    if (gap < 0 || gap > 8 || file.write(padding, gap) != gap) {
+        return false;
+    }
+    return size == 0 || file.write(data, size) == size;
+}
+
+IndexSnapshot::IndexSnapshot()
+    : m_header(nullptr)
+    , m_count(0)
+    , m_directoryCount(0)
+    , m_nameOffsets(nullptr)
+    , m_lowerOffsets(nullptr)
+    , m_directories(nullptr)
+    , m_flags(nullptr)
+    , m_charMasks(nullptr)
+    , m_pathMasks(nullptr)
+    , m_wordInitials(nullptr)
+    , m_directoryNodes(nullptr)
+    , m_nameArena(nullptr)
+    , m_lowerArena(nullptr)
+    , m_directoryArena(nullptr)
+{
+}
+
+IndexSnapshot::~IndexSnapshot()
+{
+    close();
+}
+
+QString IndexSnapshot::snapshotPath(const QString &rootDir)
+{
+    const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    const QByteArray key = QCryptographicHash::hash(QDir::cleanPath(rootDir).toUtf8(),
+                                                    QCryptographicHash::Sha1).toHex();
+    return cacheDir + "/index/" + QString::fromLatin1(key) + ".ezidx";
+}
+
+bool IndexSnapshot::write(const QString &rootDir, const EntryStore &store)
+{
+    if (store.removedCount() > 0) {
+        EntryStore compacted = store;
+        compacted.compact();
+        return write(rootDir, compacted);
+    }
+    
+    const QString filePath = snapshotPath(rootDir);
+    if (!QDir().mkpath(QFileInfo(filePath).absolutePath())) {
+        return false;
+    }
+
+    const QByteArray root = QDir::cleanPath(rootDir).toUtf8();
+    const int count = store.size();
+    const int directoryCount = store.directoryCount();
+    const quint32 nameArenaSize = count > 0 ? store.nameOffsets()[count] : 0;
+    const quint32 lowerArenaSize = count > 0 ? store.lowerOffsets()[count] : 0;
+    const quint32 directoryArenaSize = store.directoryArenaSize();
+    const quint32 emptyOffset = 0;
+
+    SnapshotHeader header = {};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.entryCount = count;
+    header.rootSize = root.size();
+    header.nameArenaSize = nameArenaSize;
+    header.lowerArenaSize = lowerArenaSize;
+    header.directoryCount = directoryCount;
+    header.directoryArenaSize = directoryArenaSize;
+    header.createdMSecs = QDateTime::currentMSecsSinceEpoch();
+
+    const SnapshotLayout layout = computeLayout(sizeof(SnapshotHeader), count, header.rootSize,
+                                                nameArenaSize, lowerArenaSize,
+                                                directoryCount, directoryArenaSize);
+
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    const bool ok =
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == sizeof(header) &&
+        writeSection(file, layout.root, root.constData(), root.size()) &&
+        writeSection(file, layout.nameOffsets,
+                     reinterpret_cast<const char *>(count > 0 ? store.nameOffsets() : &emptyOffset),
+                     qint64(count + 1) * sizeof(quint32)) &&
+        writeSection(file, layout.lowerOffsets,
+                     reinterpret_cast<const char *>(count > 0 ? store.lowerOffsets() : &emptyOffset),
+                     qint64(count + 1) * sizeof(quint32)) &&
+        writeSection(file, layout.directories,
+                     reinterpret_cast<const char *>(store.directoryData()),
+                     qint64(count) * sizeof(quint32)) &&
+        writeSection(file, layout.charMasks,
+                     reinterpret_cast<const char *>(store.characterMasks()),
+                     qint64(count) * sizeof(quint64)) &&
+        writeSection(file, layout.pathMasks,
+                     reinterpret_cast<const char *>(store.pathMasks()),
+                     qint64(count) * sizeof(quint64)) &&
+        writeSection(file, layout.wordInitials,
+                     reinterpret_cast<const char *>(store.wordInitials()),
+                     qint64(count) * sizeof(quint64)) &&
+        writeSection(file, layout.flags,
+                     reinterpret_cast<const char *>(store.flagData()), count) &&
+        writeSection(file, layout.directoryNodes,
+                     reinterpret_cast<const char *>(store.directoryNodes()),
+                     qint64(directoryCount) * sizeof(EntryStore::DirectoryNode)) &&
+        writeSection(file, layout.nameArena, store.nameArena(), nameArenaSize) &&
+        writeSection(file, layout.lowerArena, store.lowerArena(), lowerArenaSize) &&
+        writeSection(file, layout.directoryArena, store.directoryArena(), directoryArenaSize);
+
+    if (!ok) {
+        file.cancelWriting();
+        return false;
+    }
+
+    return file.commit();
+}
+
+bool IndexSnapshot::open(const QString &rootDir)
+{
+    close();
+
+    m_file.setFileName(snapshotPath(rootDir));
+    if (!m_file.open(QIODevice::ReadOnly) || m_file.size() < qint64(sizeof(SnapshotHeader))) {
+        close();
+        return false;
+    }
+
+    const uchar *data = m_file.map(0, m_file.size());
+    if (!data) {
+        close();
+        return false;
+    }
+
+    const SnapshotHeader *header = reinterpret_cast<const SnapshotHeader *>(data);
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != SNAPSHOT_VERSION || header->byteOrder != SNAPSHOT_BYTE_ORDER ||
+        header->entryCount > quint32(std::numeric_limits<int>::max() - 1) ||
+        header->directoryCount > quint32(std::numeric_limits<int>::max() - 1)) {
+        close();
+        return false;
+    }
+
+    const SnapshotLayout layout = computeLayout(sizeof(SnapshotHeader), header->entryCount,
+                                                header->rootSize, header->nameArenaSize,
+                                                header->lowerArenaSize, header->directoryCount,
+                                                header->directoryArenaSize);
+    if (layout.total > m_file.size()) {
+        close();
+        return false;
+    }
+
+    const QString storedRoot =
+        QString::fromUtf8(reinterpret_cast<const char *>(data + layout.root), header->rootSize);
+    if (storedRoot != QDir::cleanPath(rootDir)) {
+        close();
+        return false;
+    }
+
+    m_count = header->entryCount;
+    m_directoryCount = header->directoryCount;
+    m_nameOffsets = reinterpret_cast<const quint32 *>(data + layout.nameOffsets);
+    m_lowerOffsets = reinterpret_cast<const quint32 *>(data + layout.lowerOffsets);
+    m_directories = reinterpret_cast<const quint32 *>(data + layout.directories);
+    m_charMasks = reinterpret_cast<const quint64 *>(data + layout.charMasks);
+    m_pathMasks = reinterpret_cast<const quint64 *>(data + layout.pathMasks);
+    m_wordInitials = reinterpret_cast<const quint64 *>(data + layout.wordInitials);
+    m_flags = data + layout.flags;
+    m_directoryNodes =
+        reinterpret_cast<const EntryStore::DirectoryNode *>(data + layout.directoryNodes);
+    m_nameArena = reinterpret_cast<const char *>(data + layout.nameArena);
+    m_lowerArena = reinterpret_cast<const char *>(data + layout.lowerArena);
+    m_directoryArena = reinterpret_cast<const char *>(data + layout.directoryArena);
+
+    if (m_nameOffsets[m_count] != header->nameArenaSize ||
+        m_lowerOffsets[m_count] != header->lowerArenaSize) {
+        close();
+        return false;
+    }
+
+    // Offsets never decrease, so with the final ones checked every name and key lies inside
+    // its arena, and every entry's directory exists; a stale or truncated file fails here
+    // instead of reading out of bounds later
+    for (int i = 0; i < m_count; ++i) {
+        if (m_nameOffsets[i] > m_nameOffsets[i + 1] || m_lowerOffsets[i] > m_lowerOffsets[i + 1] ||
+            (m_directories[i] != quint32(EntryStore::NO_DIRECTORY) && m_directories[i] >= quint32(m_directoryCount))) {
+            close();
+            return false;
+        }
+    }
+
+    // Every directory's parent comes before it and its path and key lie inside the arena
+    for (int d = 0; d < m_directoryCount; ++d) {
+        const EntryStore::DirectoryNode &node = m_directoryNodes[d];
+        if ((node.parent != quint32(EntryStore::NO_DIRECTORY) && node.parent >= quint32(d)) ||
+            node.nameLength > node.pathLength ||
+            quint64(node.pathOffset) + node.pathLength + node.foldedLength > header->directoryArenaSize) {
+            close();
+            return false;
+        }
+    }
+
+    m_header = header;
+    m_rootDir = storedRoot;
+    return true;
+}
+
+void IndexSnapshot::close()
+{
+    if (m_file.isOpen()) {
+        m_file.close();  // Also releases the mapping
+    }
+
+    m_header = nullptr;
+    m_rootDir.clear();
+    m_count = 0;
+    m_directoryCount = 0;
+    m_nameOffsets = nullptr;
+    m_lowerOffsets = nullptr;
+    m_directories = nullptr;
+    m_flags = nullptr;
+    m_charMasks = nullptr;
+    m_pathMasks = nullptr;
+    m_wordInitials = nullptr;
+    m_directoryNodes = nullptr;
+    m_nameArena = nullptr;
+    m_lowerArena = nullptr;
+    m_directoryArena = nullptr;
+}
+
+qint64 IndexSnapshot::createdMSecs() const
+{
+    return m_header ? m_header->createdMSecs : 0;
+}
+
+QString IndexSnapshot::path(int index) const
+{
+    const QString name = QString::fromUtf8(m_nameArena + m_nameOffsets[index],
+                                           m_nameOffsets[index + 1] - m_nameOffsets[index]);
+    const quint32 directory = m_directories[index];
+    if (directory == quint32(EntryStore::NO_DIRECTORY)) {
+        return name;
+    }
+
+    const EntryStore::DirectoryNode &node = m_directoryNodes[directory];
+    return QString::fromUtf8(m_directoryArena + node.pathOffset, node.pathLength) + '/' + name;
+}
+
+QStringList IndexSnapshot::paths() const
+{
+    QStringList result;
+    result.reserve(m_count);
+
+    for (int i = 0; i < m_count; ++i) {
+        result.append(path(i));
+    }
+    return result;
+}
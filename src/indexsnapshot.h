@@ -0,0 +1,83 @@
+#ifndef INDEXSNAPSHOT_H
+#define INDEXSNAPSHOT_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QFile>
+#include <QtGlobal>
+#include "entrystore.h"
+
+// On-disk, memory-mappable copy of a built index, keyed by root directory.
+//
+// Layout (native byte order, every section 8-byte aligned):
+//   SnapshotHeader
+//   root directory          (UTF-8, rootSize bytes)
+//   name offsets            (quint32 x entryCount + 1, into the name arena)
+//   lower offsets           (quint32 x entryCount + 1, into the lower-name arena)
+//   entry directories       (quint32 x entryCount, directory id or EntryStore::NO_DIRECTORY)
+//   character masks         (quint64 x entryCount, see EntryStore::characterMaskOf)
+//   path masks              (quint64 x entryCount, see EntryStore::foldedCharacterMaskOf)
+//   word initials           (quint64 x entryCount, see EntryStore::wordInitialsOf)
+//   entry flags             (quint8 x entryCount, EntryStore::EntryFlag)
+//   directory nodes         (EntryStore::DirectoryNode x directoryCount)
+//   name arena              (UTF-8)
+//   lower-name arena        (UTF-8 search keys, see SearchKey)
+//   directory arena         (UTF-8 paths, each followed by its key when not ASCII)
+class IndexSnapshot
+{
+public:
+    IndexSnapshot();
+    ~IndexSnapshot();
+
+    static QString snapshotPath(const QString &rootDir);
+    static bool write(const QString &rootDir, const EntryStore &store);
+
+    bool open(const QString &rootDir);
+    void close();
+    bool isOpen() const { return m_header != nullptr; }
+
+    QString rootDir() const { return m_rootDir; }
+    qint64 createdMSecs() const;
+    int size() const { return m_count; }
+
+    int directoryCount() const { return m_directoryCount; }
+
+    QString path(int index) const;
+    QStringList paths() const;
+
+    // Raw sections, adopted without copying by EntryStore
+    const char *nameArena() const { return m_nameArena; }
+    const char *lowerArena() const { return m_lowerArena; }
+    const quint32 *nameOffsets() const { return m_nameOffsets; }
+    const quint32 *lowerOffsets() const { return m_lowerOffsets; }
+    const quint32 *directoryData() const { return m_directories; }
+    const quint8 *flagData() const { return m_flags; }
+    const quint64 *characterMasks() const { return m_charMasks; }
+    const quint64 *pathMasks() const { return m_pathMasks; }
+    const quint64 *wordInitials() const { return m_wordInitials; }
+    const EntryStore::DirectoryNode *directoryNodes() const { return m_directoryNodes; }
+    const char *directoryArena() const { return m_directoryArena; }
+
+private:
+    struct SnapshotHeader;
+
+    QFile m_file;
+    const SnapshotHeader *m_header;
+    QString m_rootDir;
+    int m_count;
+    int m_directoryCount;
+    const quint32 *m_nameOffsets;
+    const quint32 *m_lowerOffsets;
+    const quint32 *m_directories;
+    const quint8 *m_flags;
+    const quint64 *m_charMasks;
+    const quint64 *m_pathMasks;
+    const quint64 *m_wordInitials;
+    const EntryStore::DirectoryNode *m_directoryNodes;
+    const char *m_nameArena;
+    const char *m_lowerArena;
+    const char *m_directoryArena;
+};
+
+#endif // INDEXSNAPSHOT_H
@@ -0,0 +1,139 @@
+#include "instrumentation.h"
+
+static const char *const STAGE_NAMES[Instrumentation::StageCount] = {
+    "scan", "index", "search", "filter", "render"
+};
+
+static const char *const COUNTER_NAMES[Instrumentation::CounterCount] = {
+    "candidates", "prefilter_rejects", "cache_hits", "cache_misses"
+};
+
+// Values below 4 get a bucket each; above that a bucket spans a quarter of a power of two
+static int bucketOf(quint64 value)
+{
+    if (value < 4) {
+        return int(value);
+    }
+    const int exponent = 63 - int(qCountLeadingZeroBits(value));
+    const int quarter = int(value >> (exponent - 2)) & 3;
+    return (exponent - 1) * 4 + quarter;
+}
+
+static quint64 bucketUpperBound(int bucket)
+{
+    if (bucket < 4) {
+        return quint64(bucket);
+    }
+    const int exponent = bucket / 4 + 1;
+    const quint64 quarter = quint64(bucket % 4);
+    return ((5 + quarter) << (exponent - 2)) - 1;
+}
+
+static QByteArray milliseconds(qint64 nsecs)
+{
+    return QByteArray::number(nsecs / 1e6, 'f', 3);
+}
+
+Instrumentation &Instrumentation::instance()
+{
+    static Instrumentation instrumentation;
+    return instrumentation;
+}
+
+Instrumentation::Instrumentation()
+{
+    reset();
+}
+
+void Instrumentation::record(Stage stage, qint64 nsecs)
+{
+    Histogram &histogram = m_stages[stage];
+    nsecs = qMax<qint64>(0, nsecs);
+    histogram.buckets[bucketOf(quint64(nsecs))].fetch_add(1, std::memory_order_relaxed);
+
+    qint64 max = histogram.max.load(std::memory_order_relaxed);
+    while (nsecs > max && !histogram.max.compare_exchange_weak(max, nsecs, std::memory_order_relaxed)) {
+    }
+}
+
+Instrumentation::StageSummary Instrumentation::summary(Stage stage) const
+{
+    const Histogram &histogram = m_stages[stage];
+
+    // Samples recorded while this runs may be counted in some buckets and not others, so the
+    // total is taken from the buckets themselves
+    quint64 counts[BUCKET_COUNT];
+    quint64 samples = 0;
+    for (int b = 0; b < BUCKET_COUNT; ++b) {
+        counts[b] = histogram.buckets[b].load(std::memory_order_relaxed);
+        samples += counts[b];
+    }
+
+    StageSummary summary;
+    summary.samples = samples;
+    summary.max = histogram.max.load(std::memory_order_relaxed);
+
+    const double fractions[] = {0.50, 0.95, 0.99};
+    qint64 *percentiles[] = {&summary.p50, &summary.p95, &summary.p99};
+    for (int p = 0; p < 3; ++p) {
+        *percentiles[p] = 0;
+        const quint64 rank = qMax<quint64>(1, quint64(fractions[p] * samples + 0.999999));
+        quint64 seen = 0;
+        for (int b = 0; b < BUCKET_COUNT && samples > 0; ++b) {
+            seen += counts[b];
+            if (seen >= rank) {
+                *percentiles[p] = qMin(qint64(bucketUpperBound(b)), summary.max);
+                break;
+            }
+        }
+    }
+    return summary;
+}
+
+quint64 Instrumentation::counter(Counter counter) const
+{
+    return m_counters[counter].load(std::memory_order_relaxed);
+}
+
+void Instrumentation::reset()
+{
+    for (Histogram &histogram : m_stages) {
+        for (std::atomic<quint64> &bucket : histogram.buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        histogram.max.store(0, std::memory_order_relaxed);
+    }
+    for (std::atomic<quint64> &counter : m_counters) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+}
+
+QByteArray Instrumentation::toJson() const
+{
+    // Names and numbers only, so nothing needs escaping
+    QByteArray json = "{\n  \"stages\": {\n";
+    for (int s = 0; s < StageCount; ++s) {
+        const StageSummary stage = summary(Stage(s));
+        json += "    \"" + QByteArray(STAGE_NAMES[s]) + "\": {\"samples\": " + QByteArray::number(stage.samples) +
+                ", \"p50_ms\": " + milliseconds(stage.p50) + ", \"p95_ms\": " + milliseconds(stage.p95) +
+                ", \"p99_ms\": " + milliseconds(stage.p99) + ", \"max_ms\": " + milliseconds(stage.max) + "}";
+        json += s + 1 < StageCount ? ",\n" : "\n";
+    }
+    json += "  },\n  \"counters\": {\n";
+    for (int c = 0; c < CounterCount; ++c) {
+        json += "    \"" + QByteArray(COUNTER_NAMES[c]) + "\": " + QByteArray::number(counter(Counter(c)));
+        json += c + 1 < CounterCount ? ",\n" : "\n";
+    }
+    json += "  }\n}\n";
+    return json;
+}
+
+const char *Instrumentation::stageName(Stage stage)
+{
+    return STAGE_NAMES[stage];
+}
+
+const char *Instrumentation::counterName(Counter counter)
+{
+    return COUNTER_NAMES[counter];
+}
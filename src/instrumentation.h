@@ -0,0 +1,100 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QtGlobal>
+#include <atomic>
+
+// Process-wide latency histograms for the stages between a keystroke and a painted page, and
+// counters for the work the matcher did. Recording is lock-free and cheap enough for the hot
+// path: a span takes two monotonic clock reads and a sample one relaxed atomic add. Searches
+// count candidates once per scored chunk, not per entry.
+class Instrumentation
+{
+public:
+    enum Stage {
+        Scan,    // Walking a directory tree
+        Index,   // Building or updating the matcher's indexes
+        Search,  // Ranking one query, cache lookups included
+        Filter,  // The window's file type filter over the ranked paths
+        Render,  // Filling the result list with a page
+        StageCount
+    };
+
+    enum Counter {
+        Candidates,        // Entries scored after the character mask prefilter
+        PrefilterRejects,  // Entries the prefilter ruled out without scoring
+        CacheHits,
+        CacheMisses,
+        CounterCount
+    };
+
+    struct StageSummary {
+        quint64 samples;
+        // Nanoseconds; percentiles are bucket upper bounds, within 25% of the true value
+        qint64 p50;
+        qint64 p95;
+        qint64 p99;
+        qint64 max;
+    };
+
+    // Times its own lifetime and records it as one sample of the stage
+    class Span
+    {
+    public:
+        explicit Span(Stage stage)
+            : m_stage(stage)
+        {
+            m_timer.start();
+        }
+
+        ~Span()
+        {
+            Instrumentation::instance().record(m_stage, m_timer.nsecsElapsed());
+        }
+
+    private:
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+
+        Stage m_stage;
+        QElapsedTimer m_timer;
+    };
+
+    static Instrumentation &instance();
+
+    void record(Stage stage, qint64 nsecs);
+    void count(Counter counter, qint64 amount = 1)
+    {
+        m_counters[counter].fetch_add(quint64(amount), std::memory_order_relaxed);
+    }
+
+    StageSummary summary(Stage stage) const;
+    quint64 counter(Counter counter) const;
+    void reset();
+
+    // Every stage's summary in milliseconds and every counter, as a JSON object
+    QByteArray toJson() const;
+
+    static const char *stageName(Stage stage);
+    static const char *counterName(Counter counter);
+
+private:
+    // Log-linear: four buckets per power of two, so 256 cover every non-negative qint64
+    static const int BUCKET_COUNT = 256;
+
+    struct Histogram {
+        std::atomic<quint64> buckets[BUCKET_COUNT];
+        std::atomic<qint64> max;
+    };
+
+    Instrumentation();
+    Instrumentation(const Instrumentation &) = delete;
+    Instrumentation &operator=(const Instrumentation &) = delete;
+
+    Histogram m_stages[StageCount];
+    std::atomic<quint64> m_counters[CounterCount];
+};
+
+#endif // INSTRUMENTATION_H
@@ -3,15 +3,11 @@
 #include <QDesktopServices>
 #include <QUrl>
 #include <QFileInfo>
-#include <QDirIterator>
 #include <QDebug>
 #include <QMessageBox>
 #include <QClipboard>
 #include <QApplication>
 #include <QToolTip>
-#include <atomic>
-#include <QtConcurrent>
-#include <mutex>
 #include <QStyle>
 #include <QPalette>
 #include <QInputDialog>
@@ -20,83 +16,22 @@
 #include <QTextStream>
 #include <QMimeDatabase>
 #include <QRegularExpression>
+#include <QDateTime>
+#include <QFutureInterface>
+#include <algorithm>
 #include "syntaxhighlighter.h"
-
-static std::atomic<int> g_filesScanned(0);
-
-QStringList DirectoryScanner::scanDirectory(const QString &path)
-{
-    QStringList fileList;
-    g_filesScanned = 0;
-    
-    std::mutex fileListMutex;
-
-    QDir rootDir(path);
-    QStringList topDirs = rootDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
-    
-    topDirs.prepend(".");
-    
-    QStringList rootFiles = rootDir.entryList(QDir::Files | QDir::NoDotAndDotDot);
-    {
-        std::lock_guard<std::mutex> lock(fileListMutex);
-        for (const QString &entry : rootFiles) {
-            fileList.append(rootDir.filePath(entry));
-            g_filesScanned++;
-        }
-        
-        for (const QString &entry : topDirs) {
-            if (entry != ".") {  // Skip the "." we added ourselves
-                fileList.append(rootDir.filePath(entry));
-                g_filesScanned++;
-            }
-        }
-    }
-    
-    QFuture<void> future = QtConcurrent::map(topDirs, [&](const QString &subdir) {
-        QString fullSubdirPath = subdir == "." ? path : rootDir.filePath(subdir);
-        QStringList threadLocalFiles;
-        
-        QDirIterator it(fullSubdirPath, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
-        
-        const int batchSize = 1000;
-        int batchCount = 0;
-        
-        while (it.hasNext()) {
-            it.next();
-            threadLocalFiles.append(it.filePath());
-            
-            int filesScanned = ++g_filesScanned;
-            if (filesScanned % 1000 == 0) {
-                emit scanProgress(filesScanned);
-            }
-            
-            if (++batchCount >= batchSize) {
-                std::lock_guard<std::mutex> lock(fileListMutex);
-                fileList.append(threadLocalFiles);
-                threadLocalFiles.clear();
-                batchCount = 0;
-            }
-        }
-        
-        if (!threadLocalFiles.isEmpty()) {
-            std::lock_guard<std::mutex> lock(fileListMutex);
-            fileList.append(threadLocalFiles);
-        }
-    });
-    
-    future.waitForFinished();
-    
-    emit scanProgress(g_filesScanned);
-    
-    return fileList;
-}
+#include "resultdelegate.h"
+#include "executor.h"
+#include "indexsnapshot.h"
+#include "instrumentation.h"
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
     , m_scanWatcher(nullptr)
+    , m_extensionWatcher(nullptr)
     , m_progressDialog(nullptr)
-    , m_directoryScanner(nullptr)
+    , m_scanGeneration(0)
     , m_currentPage(0)
     , m_totalPages(0)
     , m_settings("EZ-Fuzzy", "EZ-Fuzzy-Finder")
@@ -104,10 +39,14 @@ MainWindow::MainWindow(QWidget *parent)
     , m_historyModel(new QStringListModel(this))
     , m_isDarkTheme(false)
     , m_previewEnabled(true)
+    , m_latencyLabel(nullptr)
     , m_showFiles(true)
     , m_showDirectories(false)
+    , m_revalidating(false)
+    , m_searchGeneration(0)
 {
     ui->setupUi(this);
+    ui->resultsList->setItemDelegate(new ResultDelegate(ui->resultsList));
     
     m_searchTimer.setSingleShot(true);
     connect(&m_searchTimer, &QTimer::timeout, this, &MainWindow::performSearch);
@@ -132,17 +71,17 @@ MainWindow::MainWindow(QWidget *parent)
     connect(ui->ignorePatternEdit, &QLineEdit::editingFinished,
             this, &MainWindow::onIgnorePatternChanged);
     
-    m_directoryScanner = new DirectoryScanner();
-    m_directoryScanner->moveToThread(&m_workerThread);
-    
-    connect(&m_workerThread, &QThread::finished, m_directoryScanner, &QObject::deleteLater);
-    connect(m_directoryScanner, &DirectoryScanner::scanProgress, this, &MainWindow::onScanProgress);
-    
-    m_workerThread.start(QThread::HighPriority);
-    
     m_scanWatcher = new QFutureWatcher<QStringList>(this);
     connect(m_scanWatcher, &QFutureWatcher<QStringList>::finished, this, &MainWindow::onScanFinished);
     
+    m_extensionWatcher = new QFutureWatcher<QStringList>(this);
+    connect(m_extensionWatcher, &QFutureWatcher<QStringList>::finished, this, [this]() {
+        if (!m_extensionWatcher->isCanceled()) {
+            m_fileExtensions = m_extensionWatcher->result();
+            setupFileTypeFilter();
+        }
+    });
+    
     setWindowTitle("EZ Fuzzy File Finder");
     resize(900, 600);
     
@@ -151,12 +90,17 @@ MainWindow::MainWindow(QWidget *parent)
     setupThemeSupport();
     setupContextMenu();
     setupPreviewPane();
+    setupLatencyStats();
     setupKeyboardShortcuts();
     setupIgnorePatterns();
     setupFileTypeCheckboxes();
     
     loadSettings();
     
+    // Rank by where the query lands in the path below the chosen directory, so "src/mw" finds
+    // src/mainwindow.cpp
+    m_fuzzyMatcher.setScoringMode(FuzzyMatcher::PathScoring);
+    
     m_completer = new QCompleter(m_historyModel, this);
     m_completer->setCaseSensitivity(Qt::CaseInsensitive);
     m_completer->setFilterMode(Qt::MatchContains);
@@ -169,14 +113,20 @@ MainWindow::MainWindow(QWidget *parent)
     ui->searchEdit->setFocus();
 
     m_highlighter = new SyntaxHighlighter(ui->previewTextEdit->document());
+    
+    if (!m_currentDir.isEmpty() && QDir(m_currentDir).exists() && restoreSnapshot(m_currentDir)) {
+        startRevalidation(m_currentDir);
+    }
 }
 
 MainWindow::~MainWindow()
 {
     saveSettings();
     
-    m_workerThread.quit();
-    m_workerThread.wait();
+    cancelPendingSearch(true);
+    
+    // Scans report their progress to this window, so none may outlive it
+    cancelPendingScans(true);
     
     delete ui;
     delete m_scanWatcher;
@@ -214,29 +164,166 @@ void MainWindow::onBrowseClicked()
         ui->searchEdit->clear();
         ui->resultsList->clear();
         
-        QDir topDir(dir);
-        QStringList topLevelFiles = topDir.entryList(QDir::Files | QDir::NoDotAndDotDot);
-        int dirCount = topDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot).count();
-        
-        ui->infoLabel->setText(QString("Directory: %1\nContains %2 files and %3 subdirectories at top level")
-                              .arg(QDir(dir).dirName())
-                              .arg(topLevelFiles.count())
-                              .arg(dirCount));
-        
-        statusBar()->showMessage(QString("Scanning %1...").arg(dir));
-        
-        ui->browseButton->setEnabled(false);
-        ui->searchEdit->setEnabled(false);
-        
-        createProgressDialog();
-        
-        QFuture<QStringList> future = QtConcurrent::run(m_directoryScanner, &DirectoryScanner::scanDirectory, dir);
-        m_scanWatcher->setFuture(future);
+        if (restoreSnapshot(dir)) {
+            startRevalidation(dir);
+        } else {
+            startScan(dir);
+        }
         
         m_settings.setValue("lastDirectory", dir);
     }
 }
 
+void MainWindow::startScan(const QString &dir)
+{
+    m_revalidating = false;
+    
+    QDir topDir(dir);
+    QStringList topLevelFiles = topDir.entryList(QDir::Files | QDir::NoDotAndDotDot);
+    int dirCount = topDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot).count();
+    
+    ui->infoLabel->setText(QString("Directory: %1\nContains %2 files and %3 subdirectories at top level")
+                          .arg(QDir(dir).dirName())
+                          .arg(topLevelFiles.count())
+                          .arg(dirCount));
+    
+    statusBar()->showMessage(QString("Scanning %1...").arg(dir));
+    
+    ui->browseButton->setEnabled(false);
+    ui->searchEdit->setEnabled(false);
+    
+    createProgressDialog();
+    
+    m_scanWatcher->setFuture(scanInBackground(dir));
+}
+
+void MainWindow::startRevalidation(const QString &dir)
+{
+    // Rescan in the background while the restored snapshot stays searchable
+    m_revalidating = true;
+    
+    statusBar()->showMessage(QString("Revalidating %1...").arg(dir));
+    
+    m_scanWatcher->setFuture(scanInBackground(dir));
+}
+
+QFuture<QStringList> MainWindow::scanInBackground(const QString &dir)
+{
+    // The whole scan runs on the background lane, the share of the walk the starting thread
+    // takes included, so it never holds a thread at search priority. A new scan supersedes any
+    // other still walking, since only the newest one's result is used.
+    cancelPendingScans(false);
+    
+    QFutureInterface<QStringList> future;
+    future.reportStarted();
+    
+    const quint64 generation = m_scanGeneration;
+    Executor::instance().start(Executor::Background, [this, dir, future, generation]() mutable {
+        DirectoryScanner scanner;
+        connect(&scanner, &DirectoryScanner::scanProgress, this, [this, generation](int filesFound) {
+            if (generation == m_scanGeneration) {
+                onScanProgress(filesFound);
+            }
+        });
+        
+        QStringList files = scanner.scanDirectory(dir, &future);
+        if (!future.isCanceled()) {
+            future.reportResult(files);
+        }
+        future.reportFinished();
+    });
+    
+    m_runningScans.append(future.future());
+    return future.future();
+}
+
+void MainWindow::cancelPendingScans(bool wait)
+{
+    // Progress already queued from the old scans no longer matches the generation
+    ++m_scanGeneration;
+    
+    for (QFuture<QStringList> &future : m_runningScans) {
+        future.cancel();
+        if (wait) {
+            future.waitForFinished();
+        }
+    }
+    
+    m_runningScans.erase(std::remove_if(m_runningScans.begin(), m_runningScans.end(),
+                                        [](const QFuture<QStringList> &future) {
+                                            return future.isFinished();
+                                        }),
+                         m_runningScans.end());
+}
+
+// Every live path in the index, for the few places that need the whole list at once
+static QStringList indexedPaths(const EntryStore &entries)
+{
+    QStringList paths;
+    paths.reserve(entries.liveCount());
+    for (int i = 0; i < entries.size(); ++i) {
+        if (!entries.isRemoved(i)) {
+            paths.append(entries.path(i));
+        }
+    }
+    return paths;
+}
+
+bool MainWindow::restoreSnapshot(const QString &dir)
+{
+    QSharedPointer<IndexSnapshot> snapshot(new IndexSnapshot);
+    if (!snapshot->open(dir)) {
+        return false;
+    }
+    
+    // No string per entry is built on this thread: the matcher works on the mapped sections,
+    // and the flat list comes from the revalidating scan
+    m_fileList.clear();
+    cancelPendingSearch(true);
+    m_fuzzyMatcher.setPathRoot(dir);
+    m_fuzzyMatcher.setCollection(snapshot);
+    loadUsageWeights();
+    
+    ui->infoLabel->setText(QString("Directory: %1\nRestored %2 files from index snapshot (%3)")
+                          .arg(QDir(dir).dirName())
+                          .arg(m_fuzzyMatcher.entries().liveCount())
+                          .arg(QDateTime::fromMSecsSinceEpoch(snapshot->createdMSecs()).toString()));
+    
+    // The type filter fills in once the background lane has collected the extensions
+    m_fileExtensions.clear();
+    setupFileTypeFilter();
+    
+    QFutureInterface<QStringList> extensions;
+    extensions.reportStarted();
+    Executor::instance().start(Executor::Background, [snapshot, extensions]() mutable {
+        if (!extensions.isCanceled()) {
+            extensions.reportResult(getFileTypeExtensions(snapshot->paths()));
+        }
+        extensions.reportFinished();
+    });
+    m_extensionWatcher->setFuture(extensions.future());
+    
+    // The matcher answers the empty query with its first entries
+    performSearch();
+    
+    return true;
+}
+
+void MainWindow::loadUsageWeights()
+{
+    // The matcher dropped its boosts along with the old collection
+    m_frecency.open(m_currentDir);
+    m_fuzzyMatcher.setUsageWeights(m_frecency.weights());
+    m_pendingUsage.clear();
+}
+
+void MainWindow::recordSelection(const QString &filePath)
+{
+    // The boost is applied before the next search rather than under a running one
+    m_frecency.record(filePath);
+    m_pendingUsage.append(filePath);
+}
+
 void MainWindow::createProgressDialog()
 {
     if (m_progressDialog) {
@@ -260,6 +347,11 @@ void MainWindow::createProgressDialog()
 
 void MainWindow::onScanProgress(int filesFound)
 {
+    if (m_revalidating) {
+        statusBar()->showMessage(QString("Revalidating %1... Found %2 files").arg(m_currentDir).arg(filesFound));
+        return;
+    }
+    
     if (m_progressDialog) {
         m_progressDialog->setLabelText(QString("Scanning directory... Found %1 files").arg(filesFound));
     }
@@ -273,6 +365,8 @@ void MainWindow::onScanProgress(int filesFound)
 void MainWindow::onScanFinished()
 {
     if (!m_scanWatcher->isCanceled()) {
+        // A restored index has no flat list of its own; the difference needs one
+        const QStringList previousFiles = m_revalidating ? indexedPaths(m_fuzzyMatcher.entries()) : QStringList();
         m_fileList = m_scanWatcher->result();
         
         if (!m_ignorePatterns.isEmpty()) {
@@ -291,16 +385,55 @@ void MainWindow::onScanFinished()
                               .arg(QDir(m_currentDir).dirName())
                               .arg(m_fileList.size()));
         
-        m_fuzzyMatcher.setCollection(m_fileList);
+        cancelPendingSearch(true);
+        m_fuzzyMatcher.setPathRoot(m_currentDir);
+        
+        if (m_revalidating) {
+            // The restored snapshot is usually close to the disk, so only apply the difference
+            const QSet<QString> previousSet = previousFiles.toSet();
+            const QSet<QString> currentSet = m_fileList.toSet();
+            QStringList removedFiles;
+            QStringList addedFiles;
+            
+            for (const QString &file : previousFiles) {
+                if (!currentSet.contains(file)) {
+                    removedFiles.append(file);
+                }
+            }
+            for (const QString &file : m_fileList) {
+                if (!previousSet.contains(file)) {
+                    addedFiles.append(file);
+                }
+            }
+            
+            m_fuzzyMatcher.removePaths(removedFiles);
+            m_fuzzyMatcher.addPaths(addedFiles);
+        } else {
+            m_fuzzyMatcher.setCollection(m_fileList);
+        }
+        loadUsageWeights();
+        
+        // The writer gets its own copy of the sections; the matcher may change before it runs
+        const QString rootDir = m_currentDir;
+        const QSharedPointer<const EntryStore> entries(new EntryStore(m_fuzzyMatcher.entries()));
+        Executor::instance().start(Executor::Background, [rootDir, entries]() {
+            IndexSnapshot::write(rootDir, *entries);
+        });
         
+        // The scan's list supersedes extensions still being collected from a snapshot
+        m_extensionWatcher->cancel();
         m_fileExtensions = getFileTypeExtensions(m_fileList);
         setupFileTypeFilter();
         
         if (ui->searchEdit->text().isEmpty()) {
             updateResults(m_fileList);
+        } else if (m_revalidating) {
+            performSearch();
         }
     }
     
+    m_revalidating = false;
+    
     ui->browseButton->setEnabled(true);
     ui->searchEdit->setEnabled(true);
     
@@ -318,6 +451,7 @@ void MainWindow::onItemDoubleClicked(QListWidgetItem *item)
     QString filePath = item->data(Qt::UserRole).toString();
     
     QApplication::clipboard()->setText(filePath);
+    recordSelection(filePath);
     
     statusBar()->showMessage(QString("Path copied to clipboard: %1").arg(filePath), 5000);
     
@@ -330,7 +464,15 @@ void MainWindow::performSearch()
     
     m_currentPage = 0;
     
-    if (m_fileList.isEmpty()) {
+    // A newer query supersedes whatever is still running. Picks made since the last search
+    // change the matcher's boosts, which has to wait until the running search lets go of it.
+    cancelPendingSearch(!m_pendingUsage.isEmpty());
+    for (const QString &filePath : m_pendingUsage) {
+        m_fuzzyMatcher.setUsageWeight(filePath, m_frecency.weight(filePath));
+    }
+    m_pendingUsage.clear();
+    
+    if (m_fuzzyMatcher.entries().isEmpty()) {
         ui->infoLabel->setText("No files indexed yet. Please select a directory first.");
         m_allResults.clear();
         updatePaginationControls();
@@ -338,9 +480,32 @@ void MainWindow::performSearch()
         return;
     }
     
-    m_allResults = m_fuzzyMatcher.search(query, 10000); // Large number to get most matches
+    const quint64 generation = m_searchGeneration;
+    
+    QFutureWatcher<FuzzyMatcher::SearchUpdate> *watcher = new QFutureWatcher<FuzzyMatcher::SearchUpdate>(this);
+    connect(watcher, &QFutureWatcherBase::resultReadyAt, this, [this, watcher, generation, query](int index) {
+        if (generation != m_searchGeneration) {
+            return;
+        }
+        const FuzzyMatcher::SearchUpdate update = watcher->resultAt(index);
+        showSearchResults(query, update.results, update.complete);
+    });
+    connect(watcher, &QFutureWatcherBase::finished, watcher, &QObject::deleteLater);
+    
+    // The type filter is just another restriction for the matcher to evaluate, passed apart from
+    // the typed text so that no extension is mistaken for query syntax
+    const QFuture<FuzzyMatcher::SearchUpdate> future =
+        m_fuzzyMatcher.searchAsync(query, 10000, PAGE_SIZE, m_currentFilter); // Large number to get most matches
+    m_runningSearches.append(future);
+    watcher->setFuture(future);
+}
+
+void MainWindow::showSearchResults(const QString &query, const QStringList &results, bool complete)
+{
+    m_allResults = results;
+    m_filteredResults = m_allResults;
+    m_resultsQuery = query;
     
-    applyFilter();         // Apply extension filter
     applyFileTypeFilter(); // Apply file/directory filter
     
     calculateTotalPages();
@@ -348,12 +513,17 @@ void MainWindow::performSearch()
     updatePaginationControls();
     displayCurrentPage();
     
+    // Previews only refresh the first page; the rest waits for the full answer
+    if (!complete) {
+        return;
+    }
+    
     if (m_filteredResults.isEmpty() && !query.isEmpty()) {
         ui->infoLabel->setText(QString("No files found matching '%1'").arg(query));
-    } else if (m_filteredResults.isEmpty() && query.isEmpty() && !m_fileList.isEmpty()) {
+    } else if (m_filteredResults.isEmpty() && query.isEmpty() && !m_fuzzyMatcher.entries().isEmpty()) {
         ui->infoLabel->setText(QString("Directory: %1\nFound %2 files in total. Enter a search term.")
                              .arg(QDir(m_currentDir).dirName())
-                             .arg(m_fileList.size()));
+                             .arg(m_fuzzyMatcher.entries().liveCount()));
     }
     
     if (!query.isEmpty()) {
@@ -363,11 +533,33 @@ void MainWindow::performSearch()
     onSearchFinished();
 }
 
+void MainWindow::cancelPendingSearch(bool wait)
+{
+    // Updates already queued from the old search no longer match the generation
+    ++m_searchGeneration;
+    
+    // Superseded searches may still be inside a chunk; the matcher may only change once none
+    // of them is reading it
+    for (QFuture<FuzzyMatcher::SearchUpdate> &future : m_runningSearches) {
+        future.cancel();
+        if (wait) {
+            future.waitForFinished();
+        }
+    }
+    
+    m_runningSearches.erase(std::remove_if(m_runningSearches.begin(), m_runningSearches.end(),
+                                           [](const QFuture<FuzzyMatcher::SearchUpdate> &future) {
+                                               return future.isFinished();
+                                           }),
+                            m_runningSearches.end());
+}
+
 void MainWindow::updateResults(const QStringList &results)
 {
     m_allResults = results;
+    m_filteredResults = m_allResults;
+    m_resultsQuery.clear();
     
-    applyFilter();         // Apply extension filter
     applyFileTypeFilter(); // Apply file/directory filter
     
     m_currentPage = 0;
@@ -399,7 +591,7 @@ void MainWindow::onPrevClicked()
 void MainWindow::updatePaginationControls()
 {
     if (m_filteredResults.isEmpty()) {
-        if (m_fileList.isEmpty()) {
+        if (m_fuzzyMatcher.entries().isEmpty()) {
             ui->pageInfoLabel->setText("No files indexed yet");
         } else {
             ui->pageInfoLabel->setText("No matching files");
@@ -421,10 +613,12 @@ void MainWindow::updatePaginationControls()
 
 void MainWindow::displayCurrentPage()
 {
+    Instrumentation::Span span(Instrumentation::Render);
+    
     ui->resultsList->clear();
     
     if (m_filteredResults.isEmpty()) {
-        if (m_fileList.isEmpty()) {
+        if (m_fuzzyMatcher.entries().isEmpty()) {
             QListWidgetItem *item = new QListWidgetItem("No files indexed. Click 'Browse...' to select a directory.");
             item->setFlags(item->flags() & ~Qt::ItemIsEnabled); // Make it non-selectable
             ui->resultsList->addItem(item);
@@ -442,11 +636,27 @@ void MainWindow::displayCurrentPage()
     QIcon fileIcon = QApplication::style()->standardIcon(QStyle::SP_FileIcon);
     QIcon dirIcon = QApplication::style()->standardIcon(QStyle::SP_DirIcon);
     
+    // Highlights are worked out for this page only, never during the search itself
+    const QStringList pagePaths = m_filteredResults.mid(startIdx, endIdx - startIdx);
+    const QVector<QVector<int>> matches = m_fuzzyMatcher.matchPositions(m_resultsQuery, pagePaths);
+    
     for (int i = startIdx; i < endIdx; ++i) {
         QString filePath = m_filteredResults.at(i);
         QFileInfo fileInfo(filePath);
         QListWidgetItem *item = new QListWidgetItem(fileInfo.fileName());
         
+        // Positions index the full path; the row shows just the name
+        const int nameStart = filePath.size() - fileInfo.fileName().size();
+        QVector<int> namePositions;
+        for (int position : matches.at(i - startIdx)) {
+            if (position >= nameStart) {
+                namePositions.append(position - nameStart);
+            }
+        }
+        if (!namePositions.isEmpty()) {
+            item->setData(ResultDelegate::MatchPositionsRole, QVariant::fromValue(namePositions));
+        }
+        
         if (fileInfo.isDir()) {
             item->setIcon(dirIcon);
         } else {
@@ -474,8 +684,27 @@ void MainWindow::onSearchFinished()
     saveSettings();
 }
 
+// Lane sizes, priorities and CPU sets are advanced settings: read when present in the
+// settings file, never written
+static void loadLaneSettings(const QSettings &settings, Executor::Lane lane, const QString &group)
+{
+    Executor::LaneSettings laneSettings = Executor::instance().laneSettings(lane);
+    laneSettings.threads = settings.value(group + "/threads", laneSettings.threads).toInt();
+    laneSettings.priority = QThread::Priority(settings.value(group + "/priority", int(laneSettings.priority)).toInt());
+    if (settings.contains(group + "/cpus")) {
+        laneSettings.cpus.clear();
+        for (const QString &cpu : settings.value(group + "/cpus").toString().split(',', Qt::SkipEmptyParts)) {
+            laneSettings.cpus.append(cpu.trimmed().toInt());
+        }
+    }
+    Executor::instance().setLaneSettings(lane, laneSettings);
+}
+
 void MainWindow::loadSettings()
 {
+    loadLaneSettings(m_settings, Executor::Interactive, "searchLane");
+    loadLaneSettings(m_settings, Executor::Background, "backgroundLane");
+    
     m_currentDir = m_settings.value("lastDirectory", "").toString();
     
     m_searchHistory = m_settings.value("searchHistory").toStringList();
@@ -491,6 +720,8 @@ void MainWindow::loadSettings()
     ui->actionShowPreview->setChecked(m_previewEnabled);
     ui->previewTextEdit->setVisible(m_previewEnabled);
     
+    ui->actionShowLatencyStats->setChecked(m_settings.value("latencyStatsVisible", false).toBool());
+    
     QString patterns = m_settings.value("ignorePatterns", "node_modules,.git,.svn,*.tmp").toString();
     ui->ignorePatternEdit->setText(patterns);
     m_ignorePatterns = patterns.split(",", Qt::SkipEmptyParts);
@@ -517,6 +748,8 @@ void MainWindow::saveSettings()
     
     m_settings.setValue("previewEnabled", m_previewEnabled);
     
+    m_settings.setValue("latencyStatsVisible", ui->actionShowLatencyStats->isChecked());
+    
     m_settings.setValue("ignorePatterns", ui->ignorePatternEdit->text());
     
     m_settings.setValue("showFiles", m_showFiles);
@@ -555,6 +788,7 @@ void MainWindow::setupFileTypeFilter()
     
     ui->fileTypeFilter->clear();
     ui->fileTypeFilter->addItem("All Types");
+    m_currentFilter.clear();
     
     ui->fileTypeFilter->addItems(m_fileExtensions);
     
@@ -588,27 +822,7 @@ void MainWindow::onFilterByTypeChanged(int index)
         m_currentFilter = m_fileExtensions.at(index - 1);
     }
     
-    applyFilter();
-    updatePaginationControls();
-    displayCurrentPage();
-}
-
-void MainWindow::applyFilter()
-{
-    if (m_currentFilter.isEmpty()) {
-        m_filteredResults = m_allResults;
-        return;
-    }
-    
-    m_filteredResults.clear();
-    for (const QString &filePath : m_allResults) {
-        QFileInfo fileInfo(filePath);
-        QString suffix = fileInfo.suffix().toLower();
-        
-        if (suffix == m_currentFilter.toLower()) {
-            m_filteredResults.append(filePath);
-        }
-    }
+    performSearch();
 }
 
 void MainWindow::onDarkThemeToggled(bool checked)
@@ -719,24 +933,11 @@ void MainWindow::onBookmarkSelected(int index)
         ui->searchEdit->clear();
         ui->resultsList->clear();
         
-        QDir topDir(path);
-        QStringList topLevelFiles = topDir.entryList(QDir::Files | QDir::NoDotAndDotDot);
-        int dirCount = topDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot).count();
-        
-        ui->infoLabel->setText(QString("Directory: %1\nContains %2 files and %3 subdirectories at top level")
-                              .arg(QDir(path).dirName())
-                              .arg(topLevelFiles.count())
-                              .arg(dirCount));
-        
-        statusBar()->showMessage(QString("Scanning %1...").arg(path));
-        
-        ui->browseButton->setEnabled(false);
-        ui->searchEdit->setEnabled(false);
-        
-        createProgressDialog();
-        
-        QFuture<QStringList> future = QtConcurrent::run(m_directoryScanner, &DirectoryScanner::scanDirectory, path);
-        m_scanWatcher->setFuture(future);
+        if (restoreSnapshot(path)) {
+            startRevalidation(path);
+        } else {
+            startScan(path);
+        }
     } else {
         QMessageBox::warning(this, "Invalid Bookmark", 
                             "The directory for this bookmark no longer exists. The bookmark will be removed.");
@@ -829,6 +1030,7 @@ void MainWindow::openSelectedFile()
     QString filePath = getSelectedFilePath();
     if (!filePath.isEmpty()) {
         QDesktopServices::openUrl(QUrl::fromLocalFile(filePath));
+        recordSelection(filePath);
         statusBar()->showMessage(QString("Opening file: %1").arg(filePath), 3000);
     }
 }
@@ -848,6 +1050,7 @@ void MainWindow::copyFullPath()
     QString filePath = getSelectedFilePath();
     if (!filePath.isEmpty()) {
         QApplication::clipboard()->setText(filePath);
+        recordSelection(filePath);
         statusBar()->showMessage(QString("Full path copied to clipboard: %1").arg(filePath), 3000);
     }
 }
@@ -859,6 +1062,7 @@ void MainWindow::copyFileName()
         QFileInfo fileInfo(filePath);
         QString fileName = fileInfo.fileName();
         QApplication::clipboard()->setText(fileName);
+        recordSelection(filePath);
         statusBar()->showMessage(QString("File name copied to clipboard: %1").arg(fileName), 3000);
     }
 }
@@ -872,6 +1076,7 @@ void MainWindow::copyRelativePath()
             relativePath.remove(0, m_currentDir.length() + 1);  // +1 for the slash
         }
         QApplication::clipboard()->setText(relativePath);
+        recordSelection(filePath);
         statusBar()->showMessage(QString("Relative path copied to clipboard: %1").arg(relativePath), 3000);
     }
 }
@@ -897,6 +1102,62 @@ void MainWindow::togglePreviewPane(bool checked)
     m_settings.setValue("previewEnabled", m_previewEnabled);
 }
 
+void MainWindow::setupLatencyStats()
+{
+    m_latencyLabel = new QLabel(this);
+    m_latencyLabel->setVisible(false);
+    statusBar()->addPermanentWidget(m_latencyLabel);
+    
+    m_latencyTimer.setInterval(500);
+    connect(&m_latencyTimer, &QTimer::timeout, this, &MainWindow::updateLatencyStats);
+    
+    connect(ui->actionShowLatencyStats, &QAction::toggled, this, &MainWindow::toggleLatencyStats);
+    connect(ui->actionCopyLatencyStats, &QAction::triggered, this, &MainWindow::copyLatencyStats);
+}
+
+void MainWindow::toggleLatencyStats(bool checked)
+{
+    m_latencyLabel->setVisible(checked);
+    
+    if (checked) {
+        updateLatencyStats();
+        m_latencyTimer.start();
+    } else {
+        m_latencyTimer.stop();
+    }
+    
+    m_settings.setValue("latencyStatsVisible", checked);
+}
+
+void MainWindow::updateLatencyStats()
+{
+    const Instrumentation &instrumentation = Instrumentation::instance();
+    
+    // The stages a keystroke waits on, as p50/p95/p99 in milliseconds
+    QStringList parts;
+    for (Instrumentation::Stage stage : {Instrumentation::Search, Instrumentation::Filter, Instrumentation::Render}) {
+        const Instrumentation::StageSummary summary = instrumentation.summary(stage);
+        parts.append(QString("%1 %2/%3/%4 ms")
+                     .arg(QString::fromLatin1(Instrumentation::stageName(stage)))
+                     .arg(summary.p50 / 1e6, 0, 'f', 1)
+                     .arg(summary.p95 / 1e6, 0, 'f', 1)
+                     .arg(summary.p99 / 1e6, 0, 'f', 1));
+    }
+    
+    const quint64 hits = instrumentation.counter(Instrumentation::CacheHits);
+    const quint64 lookups = hits + instrumentation.counter(Instrumentation::CacheMisses);
+    parts.append(QString("cache %1/%2").arg(hits).arg(lookups));
+    
+    m_latencyLabel->setText(parts.join("  |  "));
+    m_latencyLabel->setToolTip(QString::fromUtf8(instrumentation.toJson()));
+}
+
+void MainWindow::copyLatencyStats()
+{
+    QApplication::clipboard()->setText(QString::fromUtf8(Instrumentation::instance().toJson()));
+    statusBar()->showMessage("Latency stats copied to clipboard", 3000);
+}
+
 void MainWindow::previewSelectedFile()
 {
     if (!m_previewEnabled) {
@@ -987,11 +1248,10 @@ void MainWindow::onIgnorePatternChanged()
     QString patterns = ui->ignorePatternEdit->text();
     m_ignorePatterns = patterns.split(",", Qt::SkipEmptyParts);
     
-    if (!m_currentDir.isEmpty() && !m_fileList.isEmpty()) {
+    if (!m_currentDir.isEmpty() && !m_fuzzyMatcher.entries().isEmpty()) {
         statusBar()->showMessage("Applying new ignore patterns...", 2000);
         
-        QFuture<QStringList> future = QtConcurrent::run(m_directoryScanner, &DirectoryScanner::scanDirectory, m_currentDir);
-        m_scanWatcher->setFuture(future);
+        m_scanWatcher->setFuture(scanInBackground(m_currentDir));
     }
 }
 
@@ -1154,6 +1414,9 @@ void MainWindow::applyFileTypeFilter()
         return;
     }
     
+    // Only passes that stat the results are timed
+    Instrumentation::Span span(Instrumentation::Filter);
+    
     QStringList tempResults = m_filteredResults;
     m_filteredResults.clear();
     
@@ -12,7 +12,6 @@
 #include <QThread>
 #include <QFuture>
 #include <QFutureWatcher>
-#include <QtConcurrent>
 #include <QProgressDialog>
 #include <QSettings>
 #include <QCompleter>
@@ -26,25 +25,16 @@
 #include <QTextEdit>
 #include <QProcess>
 #include <QCheckBox>
+#include <QLabel>
 #include "fuzzymatcher.h"
+#include "directoryscanner.h"
+#include "frecencystore.h"
 #include "syntaxhighlighter.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
 
-class DirectoryScanner : public QObject
-{
-    Q_OBJECT
-public:
-    explicit DirectoryScanner(QObject *parent = nullptr) : QObject(parent) {}
-    
-    QStringList scanDirectory(const QString &path);
-
-signals:
-    void scanProgress(int filesFound);
-};
-
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -79,6 +69,10 @@ private slots:
     void previewSelectedFile();
     void togglePreviewPane(bool checked);
     
+    void toggleLatencyStats(bool checked);
+    void updateLatencyStats();
+    void copyLatencyStats();
+    
     void handleKeyUp();
     void handleKeyDown();
     void handleKeyEnter();
@@ -96,11 +90,16 @@ private:
     QTimer m_searchTimer;
     QString m_currentDir;
     QFutureWatcher<QStringList> *m_scanWatcher;
+    QFutureWatcher<QStringList> *m_extensionWatcher;  // Type filter entries of a restored index
     QProgressDialog *m_progressDialog;
-    QThread m_workerThread;
-    DirectoryScanner *m_directoryScanner;
+    
+    // Scans that may still be walking, each with its own scanner; they report progress to this
+    // window, so all of them are cancelled and waited for before it goes away
+    QList<QFuture<QStringList>> m_runningScans;
+    quint64 m_scanGeneration;
     
     QStringList m_allResults;
+    QString m_resultsQuery;  // The query m_allResults answer, for highlighting
     int m_currentPage;
     int m_totalPages;
     static const int PAGE_SIZE = 200;
@@ -137,6 +136,10 @@ private:
     bool m_previewEnabled;
     QTimer m_previewTimer;
     
+    // Status bar readout of the instrumented stages, refreshed while it is shown
+    QLabel *m_latencyLabel;
+    QTimer m_latencyTimer;
+    
     QShortcut *m_upShortcut;
     QShortcut *m_downShortcut;
     QShortcut *m_enterShortcut;
@@ -150,12 +153,33 @@ private:
     bool m_showFiles;
     bool m_showDirectories;
     
+    bool m_revalidating;
+    
+    // Searches that may still be reading the matcher, the newest last; a cancelled search keeps
+    // running until its current chunk ends, so all of them are waited for before the matcher
+    // changes. Results from older generations are dropped.
+    QList<QFuture<FuzzyMatcher::SearchUpdate>> m_runningSearches;
+    quint64 m_searchGeneration;
+    
+    // Picks from the results, fed back to the matcher as ranking boosts
+    FrecencyStore m_frecency;
+    QStringList m_pendingUsage;  // Picked since the matcher's boosts were last updated
+    
     SyntaxHighlighter *m_highlighter;
     
     void updateResults(const QStringList &results);
     void updatePaginationControls();
     void displayCurrentPage();
+    void showSearchResults(const QString &query, const QStringList &results, bool complete);
+    void cancelPendingSearch(bool wait);
     void createProgressDialog();
+    void startScan(const QString &dir);
+    void startRevalidation(const QString &dir);
+    QFuture<QStringList> scanInBackground(const QString &dir);
+    void cancelPendingScans(bool wait);
+    bool restoreSnapshot(const QString &dir);
+    void loadUsageWeights();
+    void recordSelection(const QString &filePath);
     
     void loadSettings();
     void saveSettings();
@@ -167,12 +191,12 @@ private:
     void setupThemeSupport();
     void setupContextMenu();
     void setupPreviewPane();
+    void setupLatencyStats();
     void setupKeyboardShortcuts();
     void setupIgnorePatterns();
-    void applyFilter();
     void applyTheme();
     void updateBookmarks();
-    QStringList getFileTypeExtensions(const QStringList &files);
+    static QStringList getFileTypeExtensions(const QStringList &files);
     QString getSelectedFilePath() const;
     QString getFilePreview(const QString &filePath, int maxLines = 200) const;
     bool isFileTypeText(const QString &filePath) const;
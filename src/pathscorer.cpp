@@ -0,0 +1,352 @@
+#include "pathscorer.h"
+#include <QVarLengthArray>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+enum CharClass {
+    ClassNonWord,
+    ClassDelimiter,
+    ClassWhite,
+    ClassLower,
+    ClassUpper,
+    ClassDigit,
+    ClassCount
+};
+
+// Far enough below any real alignment that it never wins a max, far enough above the 16-bit
+// floor that adding a column's gains cannot wrap
+const int NEG_SCORE = -16384;
+
+// Longest window the 16-bit kernel accepts; longer ones would let gap penalties reach NEG_SCORE
+const int MAX_VECTOR_WINDOW = 4096;
+
+struct Tables {
+    uchar fold[256];
+    uchar charClass[256];
+    qint8 bonus[ClassCount][ClassCount];  // [previous][current]
+
+    Tables()
+    {
+        for (int c = 0; c < 256; ++c) {
+            fold[c] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+
+            if (c >= 'a' && c <= 'z') {
+                charClass[c] = ClassLower;
+            } else if (c >= 'A' && c <= 'Z') {
+                charClass[c] = ClassUpper;
+            } else if (c >= '0' && c <= '9') {
+                charClass[c] = ClassDigit;
+            } else if (c == '/' || c == '\\') {
+                charClass[c] = ClassDelimiter;
+            } else if (c == ' ' || c == '\t') {
+                charClass[c] = ClassWhite;
+            } else if (c >= 0x80) {
+                charClass[c] = ClassLower;  // Part of a multi-byte letter
+            } else {
+                charClass[c] = ClassNonWord;
+            }
+        }
+
+        for (int previous = 0; previous < ClassCount; ++previous) {
+            for (int current = 0; current < ClassCount; ++current) {
+                bonus[previous][current] = bonusFor(CharClass(previous), CharClass(current));
+            }
+        }
+    }
+
+    static int bonusFor(CharClass previous, CharClass current)
+    {
+        if (current == ClassDelimiter || current == ClassNonWord) {
+            return PathScorer::BonusNonWord;
+        }
+        if (current == ClassWhite) {
+            return PathScorer::BonusBoundaryWhite;
+        }
+        if (previous == ClassWhite) {
+            return PathScorer::BonusBoundaryWhite;
+        }
+        if (previous == ClassDelimiter) {
+            return PathScorer::BonusBoundaryDelimiter;
+        }
+        if (previous == ClassNonWord) {
+            return PathScorer::BonusBoundary;
+        }
+        if ((previous == ClassLower && current == ClassUpper) ||
+            (previous != ClassDigit && current == ClassDigit)) {
+            return PathScorer::BonusCamel123;
+        }
+        return 0;
+    }
+};
+
+const Tables &tables()
+{
+    static const Tables instance;
+    return instance;
+}
+
+inline int bonusAt(const Tables &t, const char *path, int index, int nameOffset)
+{
+    // The start of the path counts as following a separator
+    const int previous = index > 0 ? int(t.charClass[uchar(path[index - 1])]) : int(ClassDelimiter);
+    const int bonus = t.bonus[previous][t.charClass[uchar(path[index])]];
+    return index >= nameOffset ? bonus + PathScorer::BonusFileName : bonus;
+}
+
+} // namespace
+
+PathScorer::PathScorer(const QByteArray &pattern)
+    : m_pattern(pattern)
+{
+}
+
+int PathScorer::score(const char *path, int length, int nameOffset) const
+{
+    if (m_pattern.isEmpty()) {
+        return 1;
+    }
+
+    int begin = 0;
+    int end = 0;
+    if (!findWindow(path, length, begin, end)) {
+        return 0;
+    }
+
+    int best;
+#ifdef __SSE2__
+    if (m_pattern.size() <= 8 && end - begin <= MAX_VECTOR_WINDOW) {
+        best = vectorAlign<false>(path, begin, end, nameOffset);
+    } else if (m_pattern.size() <= 16 && end - begin <= MAX_VECTOR_WINDOW) {
+        best = vectorAlign<true>(path, begin, end, nameOffset);
+    } else
+#endif
+    {
+        best = scalarAlign(path, begin, end, nameOffset);
+    }
+
+    // Long gaps can push a genuine match below zero; it still beats a non-match
+    return qMax(1, best);
+}
+
+bool PathScorer::findWindow(const char *path, int length, int &begin, int &end) const
+{
+    // Greedy forward pass proves the pattern is a subsequence and gives the earliest start;
+    // the alignment cannot use anything after the last occurrence of the final pattern byte
+    const Tables &t = tables();
+    const char *pattern = m_pattern.constData();
+    const int patternLength = m_pattern.size();
+
+    int matched = 0;
+    begin = -1;
+    for (int i = 0; i < length; ++i) {
+        if (char(t.fold[uchar(path[i])]) == pattern[matched]) {
+            if (matched == 0) {
+                begin = i;
+            }
+            if (++matched == patternLength) {
+                break;
+            }
+        }
+    }
+    if (matched < patternLength) {
+        return false;
+    }
+
+    const char last = pattern[patternLength - 1];
+    end = length;
+    while (char(t.fold[uchar(path[end - 1])]) != last) {
+        --end;
+    }
+    return true;
+}
+
+int PathScorer::scalarAlign(const char *path, int begin, int end, int nameOffset) const
+{
+    const Tables &t = tables();
+    const char *pattern = m_pattern.constData();
+    const int patternLength = m_pattern.size();
+
+    // match: pattern[i] matched at the current byte; gap: pattern[i] matched earlier
+    QVarLengthArray<int, 64> match(patternLength);
+    QVarLengthArray<int, 64> gap(patternLength);
+    QVarLengthArray<int, 64> best(patternLength);
+    for (int i = 0; i < patternLength; ++i) {
+        match[i] = NEG_SCORE;
+        gap[i] = NEG_SCORE;
+        best[i] = NEG_SCORE;
+    }
+    int result = NEG_SCORE;
+
+    for (int j = begin; j < end; ++j) {
+        const char c = char(t.fold[uchar(path[j])]);
+        const int bonus = bonusAt(t, path, j, nameOffset);
+        const int consecutiveGain = ScoreMatch + qMax(bonus, int(BonusConsecutive));
+
+        // Walk the column downwards so row i - 1 still holds the previous byte's values
+        for (int i = patternLength - 1; i >= 0; --i) {
+            const int diagonalMatch = i > 0 ? match[i - 1] : NEG_SCORE;
+            const int diagonalBest = i > 0 ? best[i - 1] : 0;
+            const int gapGain = ScoreMatch + (i == 0 ? bonus * BonusFirstCharMultiplier : bonus);
+
+            const int nextGap = qMax(match[i] - PenaltyGapStart, gap[i] - PenaltyGapExtension);
+            const int nextMatch = pattern[i] == c
+                                      ? qMax(diagonalMatch + consecutiveGain, diagonalBest + gapGain)
+                                      : NEG_SCORE;
+            match[i] = nextMatch;
+            gap[i] = nextGap;
+            best[i] = qMax(nextMatch, nextGap);
+        }
+        result = qMax(result, match[patternLength - 1]);
+    }
+    return result;
+}
+
+int PathScorer::align(const char *path, int length, int nameOffset, int *positions) const
+{
+    if (m_pattern.isEmpty()) {
+        return 1;
+    }
+
+    int begin = 0;
+    int end = 0;
+    if (!findWindow(path, length, begin, end)) {
+        return 0;
+    }
+
+    const Tables &t = tables();
+    const char *pattern = m_pattern.constData();
+    const int patternLength = m_pattern.size();
+
+    // The same recurrence as scalarAlign(), one column of match and gap cells per window byte
+    QVarLengthArray<int, 1024> match(patternLength * (end - begin));
+    QVarLengthArray<int, 1024> gap(patternLength * (end - begin));
+    auto cell = [&](int i, int j) { return (j - begin) * patternLength + i; };
+
+    int result = NEG_SCORE;
+    int resultColumn = begin;
+    for (int j = begin; j < end; ++j) {
+        const char c = char(t.fold[uchar(path[j])]);
+        const int bonus = bonusAt(t, path, j, nameOffset);
+        const int consecutiveGain = ScoreMatch + qMax(bonus, int(BonusConsecutive));
+
+        for (int i = 0; i < patternLength; ++i) {
+            const bool first = j == begin;
+            const int previousMatch = first ? NEG_SCORE : match[cell(i, j - 1)];
+            const int previousGap = first ? NEG_SCORE : gap[cell(i, j - 1)];
+            const int diagonalMatch = i > 0 && !first ? match[cell(i - 1, j - 1)] : NEG_SCORE;
+            const int diagonalBest = i == 0 ? 0
+                                   : first ? NEG_SCORE
+                                           : qMax(match[cell(i - 1, j - 1)], gap[cell(i - 1, j - 1)]);
+            const int gapGain = ScoreMatch + (i == 0 ? bonus * BonusFirstCharMultiplier : bonus);
+
+            gap[cell(i, j)] = qMax(previousMatch - PenaltyGapStart, previousGap - PenaltyGapExtension);
+            match[cell(i, j)] = pattern[i] == c
+                                    ? qMax(diagonalMatch + consecutiveGain, diagonalBest + gapGain)
+                                    : NEG_SCORE;
+        }
+        if (match[cell(patternLength - 1, j)] > result) {
+            result = match[cell(patternLength - 1, j)];
+            resultColumn = j;
+        }
+    }
+
+    // Walk back from the best final cell, taking whichever move produced each value
+    int j = resultColumn;
+    for (int i = patternLength - 1; ; --i) {
+        positions[i] = j;
+        if (i == 0) {
+            break;
+        }
+
+        const int consecutiveGain = ScoreMatch + qMax(bonusAt(t, path, j, nameOffset), int(BonusConsecutive));
+        if (match[cell(i - 1, j - 1)] + consecutiveGain == match[cell(i, j)]) {
+            --j;
+            continue;
+        }
+
+        // The previous byte matched earlier; follow the gap back to where it opened
+        int k = j - 1;
+        if (match[cell(i - 1, k)] < gap[cell(i - 1, k)]) {
+            while (k > begin + 1 && match[cell(i - 1, k - 1)] - PenaltyGapStart != gap[cell(i - 1, k)]) {
+                --k;
+            }
+            --k;
+        }
+        j = k;
+    }
+
+    return qMax(1, result);
+}
+
+#ifdef __SSE2__
+template <bool Wide>
+int PathScorer::vectorAlign(const char *path, int begin, int end, int nameOffset) const
+{
+    const Tables &t = tables();
+    const int patternLength = m_pattern.size();
+
+    // Pattern bytes in 16-bit lanes; unused lanes hold -1, which no text byte equals
+    qint16 lanes[16];
+    for (int i = 0; i < 16; ++i) {
+        lanes[i] = i < patternLength ? qint16(uchar(m_pattern.at(i))) : qint16(-1);
+    }
+    const __m128i patternLo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lanes));
+    const __m128i patternHi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lanes + 8));
+
+    const __m128i neg = _mm_set1_epi16(NEG_SCORE);
+    const __m128i gapStart = _mm_set1_epi16(PenaltyGapStart);
+    const __m128i gapExtension = _mm_set1_epi16(PenaltyGapExtension);
+
+    __m128i matchLo = neg, gapLo = neg, bestLo = neg, resultLo = neg;
+    __m128i matchHi = neg, gapHi = neg, bestHi = neg, resultHi = neg;
+
+    for (int j = begin; j < end; ++j) {
+        const int bonus = bonusAt(t, path, j, nameOffset);
+        const __m128i text = _mm_set1_epi16(t.fold[uchar(path[j])]);
+        const __m128i consecutiveGain = _mm_set1_epi16(ScoreMatch + qMax(bonus, int(BonusConsecutive)));
+        const __m128i gapGainHi = _mm_set1_epi16(ScoreMatch + bonus);
+        const __m128i gapGainLo =
+            _mm_insert_epi16(gapGainHi, ScoreMatch + bonus * BonusFirstCharMultiplier, 0);
+
+        // Previous column shifted down one pattern row; row 0 starts from nothing matched
+        const __m128i diagonalMatchLo = _mm_insert_epi16(_mm_slli_si128(matchLo, 2), NEG_SCORE, 0);
+        const __m128i diagonalBestLo = _mm_slli_si128(bestLo, 2);
+
+        __m128i nextMatchLo = _mm_max_epi16(_mm_adds_epi16(diagonalMatchLo, consecutiveGain),
+                                            _mm_adds_epi16(diagonalBestLo, gapGainLo));
+        const __m128i equalLo = _mm_cmpeq_epi16(patternLo, text);
+        nextMatchLo = _mm_or_si128(_mm_and_si128(equalLo, nextMatchLo), _mm_andnot_si128(equalLo, neg));
+        gapLo = _mm_max_epi16(_mm_subs_epi16(matchLo, gapStart), _mm_subs_epi16(gapLo, gapExtension));
+
+        if (Wide) {
+            const __m128i diagonalMatchHi =
+                _mm_or_si128(_mm_slli_si128(matchHi, 2), _mm_srli_si128(matchLo, 14));
+            const __m128i diagonalBestHi =
+                _mm_or_si128(_mm_slli_si128(bestHi, 2), _mm_srli_si128(bestLo, 14));
+
+            __m128i nextMatchHi = _mm_max_epi16(_mm_adds_epi16(diagonalMatchHi, consecutiveGain),
+                                                _mm_adds_epi16(diagonalBestHi, gapGainHi));
+            const __m128i equalHi = _mm_cmpeq_epi16(patternHi, text);
+            nextMatchHi = _mm_or_si128(_mm_and_si128(equalHi, nextMatchHi), _mm_andnot_si128(equalHi, neg));
+            gapHi = _mm_max_epi16(_mm_subs_epi16(matchHi, gapStart), _mm_subs_epi16(gapHi, gapExtension));
+
+            matchHi = nextMatchHi;
+            bestHi = _mm_max_epi16(matchHi, gapHi);
+            resultHi = _mm_max_epi16(resultHi, matchHi);
+        }
+
+        matchLo = nextMatchLo;
+        bestLo = _mm_max_epi16(matchLo, gapLo);
+        resultLo = _mm_max_epi16(resultLo, matchLo);
+    }
+
+    qint16 results[16];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(results), resultLo);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(results + 8), resultHi);
+    return results[patternLength - 1];
+}
+#endif
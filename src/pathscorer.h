@@ -0,0 +1,54 @@
+#ifndef PATHSCORER_H
+#define PATHSCORER_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+// Local alignment of a lowercased query against a full path, in the spirit of fzf's v2
+// algorithm. Every matched byte earns a base score plus a bonus for where it lands: after a
+// path separator, after punctuation or whitespace, on a camelCase or digit transition, or
+// inside the file name. Consecutive matches keep their bonus and gaps cost an affine penalty.
+//
+// The DP runs one text byte at a time over the whole query column. Every cell of a column
+// depends only on the previous column, so for queries of up to 16 bytes the column lives in
+// two SSE2 registers of 16-bit lanes and each text byte costs a handful of vector operations.
+class PathScorer
+{
+public:
+    enum Scores {
+        ScoreMatch = 16,
+        PenaltyGapStart = 3,
+        PenaltyGapExtension = 1,
+        BonusBoundaryWhite = 10,
+        BonusBoundaryDelimiter = 9,
+        BonusBoundary = 8,
+        BonusNonWord = 8,
+        BonusCamel123 = 7,
+        BonusConsecutive = 4,
+        BonusFileName = 2,
+        BonusFirstCharMultiplier = 2
+    };
+
+    explicit PathScorer(const QByteArray &pattern);
+
+    int patternLength() const { return m_pattern.size(); }
+
+    // At least 1 when the pattern is a case-insensitive subsequence of the path, 0 otherwise.
+    // nameOffset is where the file name starts inside the path.
+    int score(const char *path, int length, int nameOffset) const;
+
+    // Scores like score() and also stores, for every pattern byte, the index of the path byte
+    // it matched; positions needs room for patternLength() entries. Keeps the whole DP table
+    // for the traceback, so it is meant for the handful of results on screen, not for ranking.
+    int align(const char *path, int length, int nameOffset, int *positions) const;
+
+private:
+    bool findWindow(const char *path, int length, int &begin, int &end) const;
+    int scalarAlign(const char *path, int begin, int end, int nameOffset) const;
+    template <bool Wide>
+    int vectorAlign(const char *path, int begin, int end, int nameOffset) const;
+
+    QByteArray m_pattern;
+};
+
+#endif // PATHSCORER_H
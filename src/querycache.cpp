@@ -0,0 +1,83 @@
+#include "querycache.h"
+
+QueryCache::QueryCache(qint64 budget)
+    : m_budget(budget)
+    , m_cost(0)
+{
+}
+
+void QueryCache::setBudget(qint64 bytes)
+{
+    m_budget = qMax<qint64>(0, bytes);
+    evict();
+}
+
+bool QueryCache::lookup(const QString &query, Result &result)
+{
+    const auto it = m_index.constFind(query);
+    if (it == m_index.constEnd()) {
+        return false;
+    }
+
+    m_nodes.splice(m_nodes.begin(), m_nodes, it.value());
+    result = it.value()->result;
+    return true;
+}
+
+void QueryCache::insert(const QString &query, const Result &result)
+{
+    const auto existing = m_index.find(query);
+    if (existing != m_index.end()) {
+        m_cost -= existing.value()->cost;
+        m_nodes.erase(existing.value());
+        m_index.erase(existing);
+    }
+
+    Node node;
+    node.query = query;
+    node.result = result;
+    node.cost = costOf(node);
+    if (node.cost > m_budget) {
+        return;
+    }
+
+    m_nodes.push_front(node);
+    m_index.insert(query, m_nodes.begin());
+    m_cost += node.cost;
+    evict();
+}
+
+void QueryCache::clear()
+{
+    m_nodes.clear();
+    m_index.clear();
+    m_cost = 0;
+}
+
+void QueryCache::update(const std::function<void(const QString &query, Result &result)> &fn)
+{
+    m_cost = 0;
+    for (Node &node : m_nodes) {
+        fn(node.query, node.result);
+        node.cost = costOf(node);
+        m_cost += node.cost;
+    }
+    evict();
+}
+
+qint64 QueryCache::costOf(const Node &node)
+{
+    // Container headers and list/hash bookkeeping, plus the payload itself
+    return qint64(sizeof(Node)) + 64 + node.query.size() * qint64(sizeof(QChar)) +
+           node.result.ids.size() * qint64(sizeof(int) * 2);
+}
+
+void QueryCache::evict()
+{
+    while (m_cost > m_budget && !m_nodes.empty()) {
+        const Node &oldest = m_nodes.back();
+        m_cost -= oldest.cost;
+        m_index.remove(oldest.query);
+        m_nodes.pop_back();
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef QUERYCACHE_H
+#define QUERYCACHE_H
+
+#include <QString>
+#include <QHash>
+#include <QVector>
+#include <functional>
+#include <list>
+
+// Least-recently-used cache of ranked search results, bounded by an estimate of the bytes it
+// holds rather than by a number of queries. Results are kept as stable entry ids with their
+// scores, so they survive compaction and can be patched in place when entries come and go.
+class QueryCache
+{
+public:
+    struct Result {
+        QVector<int> ids;  // Stable entry ids, best first
+        QVector<int> scores;
+        bool complete = false;  // Holds every matching entry, not only the best ones
+    };
+
+    static const qint64 DEFAULT_BUDGET = 16 * 1024 * 1024;
+
+    explicit QueryCache(qint64 budget = DEFAULT_BUDGET);
+
+    void setBudget(qint64 bytes);
+    qint64 budget() const { return m_budget; }
+    qint64 cost() const { return m_cost; }
+    int size() const { return m_index.size(); }
+
+    // Marks the query as most recently used when found
+    bool lookup(const QString &query, Result &result);
+    void insert(const QString &query, const Result &result);
+    void clear();
+
+    // Lets fn rewrite every cached result in place, then re-applies the budget
+    void update(const std::function<void(const QString &query, Result &result)> &fn);
+
+private:
+    struct Node {
+        QString query;
+        Result result;
+        qint64 cost;
+    };
+
+    static qint64 costOf(const Node &node);
+    void evict();
+
+    std::list<Node> m_nodes;  // Most recently used first
+    QHash<QString, std::list<Node>::iterator> m_index;
+    qint64 m_budget;
+    qint64 m_cost;
+};
+
+#endif // QUERYCACHE_H
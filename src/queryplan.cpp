@@ -0,0 +1,168 @@
+#include "queryplan.h"
+#include <algorithm>
+#include <cstring>
+
+static inline uchar foldAscii(uchar c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static bool foldedEquals(const char *text, const char *needle, int length)
+{
+    for (int i = 0; i < length; ++i) {
+        if (foldAscii(text[i]) != uchar(needle[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool foldedContains(const char *text, int length, const char *needle, int needleLength)
+{
+    const uchar first = needle[0];
+    for (int i = 0; i + needleLength <= length; ++i) {
+        if (foldAscii(text[i]) == first && foldedEquals(text + i + 1, needle + 1, needleLength - 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool isExtension(const QString &text)
+{
+    return !text.isEmpty() && !text.contains('.') && !text.contains('/');
+}
+
+QueryPlan::QueryPlan(const QString &queryLower)
+{
+    const QStringList tokens = queryLower.simplified().split(' ', Qt::SkipEmptyParts);
+
+    for (QString token : tokens) {
+        Predicate predicate;
+        predicate.negated = token.size() > 1 && token.startsWith('!');
+        if (predicate.negated) {
+            token.remove(0, 1);
+        }
+
+        const bool anchoredStart = token.size() > 1 && token.startsWith('^');
+        const bool anchoredEnd = token.size() > 1 && token.endsWith('$');
+
+        if (token.size() > 1 && token.startsWith('\'')) {
+            predicate.kind = Contains;
+            token.remove(0, 1);
+        } else if (anchoredStart && anchoredEnd && token.size() > 2) {
+            predicate.kind = Equals;
+            token = token.mid(1, token.size() - 2);
+        } else if (anchoredStart) {
+            predicate.kind = Prefix;
+            token.remove(0, 1);
+        } else if (anchoredEnd) {
+            predicate.kind = Suffix;
+            token.chop(1);
+        } else if (token.size() > 1 && token.startsWith('.') && isExtension(token.mid(1))) {
+            predicate.kind = Extension;
+            token.remove(0, 1);
+        } else if (predicate.negated) {
+            predicate.kind = Contains;
+        } else {
+            m_terms.append(token);
+            continue;
+        }
+
+        predicate.text = token.toUtf8();
+        m_predicates.append(predicate);
+    }
+
+    std::stable_sort(m_predicates.begin(), m_predicates.end(),
+                     [](const Predicate &a, const Predicate &b) { return a.kind < b.kind; });
+
+    m_key = isSimple() ? m_terms.first() : tokens.join(" ");
+}
+
+void QueryPlan::restrictExtension(const QString &extensionLower)
+{
+    Predicate predicate;
+    predicate.kind = Extension;
+    predicate.text = extensionLower.toUtf8();
+    predicate.negated = false;
+    m_predicates.append(predicate);
+
+    std::stable_sort(m_predicates.begin(), m_predicates.end(),
+                     [](const Predicate &a, const Predicate &b) { return a.kind < b.kind; });
+
+    // Typed tokens are simplified, so a newline keeps this key apart from any query's
+    m_key += "\n." + extensionLower;
+}
+
+bool QueryPlan::isSimpleQuery(const QString &queryLower)
+{
+    return QueryPlan(queryLower).isSimple();
+}
+
+QByteArray QueryPlan::requiredText() const
+{
+    QByteArray text;
+    for (const Predicate &predicate : m_predicates) {
+        if (!predicate.negated) {
+            text += predicate.text;
+        }
+    }
+    return text;
+}
+
+QByteArray QueryPlan::longestRequiredSubstring(bool wholePath) const
+{
+    QByteArray longest;
+    for (const Predicate &predicate : m_predicates) {
+        const bool onName = predicate.kind == Extension || predicate.kind == Equals ||
+                            predicate.kind == Prefix;
+        if (predicate.negated || (wholePath && !onName)) {
+            continue;
+        }
+        const QByteArray text =
+            predicate.kind == Extension ? QByteArray(".") + predicate.text : predicate.text;
+        if (text.size() > longest.size()) {
+            longest = text;
+        }
+    }
+    return longest;
+}
+
+bool QueryPlan::accepts(const char *target, int targetLength, const char *name, int nameLength) const
+{
+    for (const Predicate &predicate : m_predicates) {
+        const char *text = predicate.text.constData();
+        const int length = predicate.text.size();
+        bool matched = false;
+
+        switch (predicate.kind) {
+        case Extension: {
+            int dot = nameLength - 1;
+            while (dot >= 0 && name[dot] != '.') {
+                --dot;
+            }
+            matched = dot >= 0 && nameLength - dot - 1 == length &&
+                      memcmp(name + dot + 1, text, length) == 0;
+            break;
+        }
+        case Equals:
+            matched = nameLength == length && memcmp(name, text, length) == 0;
+            break;
+        case Prefix:
+            matched = nameLength >= length && memcmp(name, text, length) == 0;
+            break;
+        case Suffix:
+            matched = targetLength >= length &&
+                      foldedEquals(target + targetLength - length, text, length);
+            break;
+        case Contains:
+            matched = foldedContains(target, targetLength, text, length);
+            break;
+        }
+
+        if (matched == predicate.negated) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef QUERYPLAN_H
+#define QUERYPLAN_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+#include <QtGlobal>
+
+// A lowercased query split into whitespace-separated tokens, every one of which must hold:
+//
+//   term     fuzzy match, the only kind of token that contributes to the score
+//   'term    contains term exactly       term$    ends with term
+//   ^term    file name starts with term  ^term$   file name is exactly term
+//   .ext     file name has extension ext
+//   !token   negates any of the above; a negated plain term means "does not contain term"
+//
+// Exact and suffix tokens look at what the scoring mode matches: the file name, or the whole
+// path in path mode. Anchored and extension tokens always look at the file name.
+//
+// Everything but fuzzy terms becomes a predicate. Predicates are sorted cheapest first so
+// that accepts() rejects most entries after a comparison or two, before any term is scored.
+class QueryPlan
+{
+public:
+    // In order of increasing cost
+    enum PredicateKind {
+        Extension,
+        Equals,
+        Prefix,
+        Suffix,
+        Contains
+    };
+
+    struct Predicate {
+        PredicateKind kind;
+        QByteArray text;  // Lowercased UTF-8
+        bool negated;
+    };
+
+    explicit QueryPlan(const QString &queryLower);
+
+    // Adds an extension restriction that is not part of the query text, such as a file type
+    // picked from a list; the extension is a SearchKey without the dot and may hold any
+    // character, spaces included
+    void restrictExtension(const QString &extensionLower);
+
+    bool isEmpty() const { return m_terms.isEmpty() && m_predicates.isEmpty(); }
+    // A single fuzzy term and nothing else, which the matcher's plain search handles
+    bool isSimple() const { return m_terms.size() == 1 && m_predicates.isEmpty(); }
+    static bool isSimpleQuery(const QString &queryLower);
+
+    // The tokens joined by single spaces; the term itself for simple queries
+    QString key() const { return m_key; }
+    const QStringList &terms() const { return m_terms; }
+    const QVector<Predicate> &predicates() const { return m_predicates; }
+
+    // Bytes every accepted target must contain, for filtering on character masks
+    QByteArray requiredText() const;
+
+    // Checks every predicate against the target (the name or the whole path, compared with
+    // ASCII case folding) or the lowercased file name
+    bool accepts(const char *target, int targetLength, const char *name, int nameLength) const;
+
+    // Longest text an accepted lowercased file name must contain, for index lookups. Exact
+    // and suffix tokens only count when they apply to the name rather than the whole path.
+    QByteArray longestRequiredSubstring(bool wholePath) const;
+
+private:
+    QStringList m_terms;
+    QVector<Predicate> m_predicates;
+    QString m_key;
+};
+
+#endif // QUERYPLAN_H
@@ -0,0 +1,68 @@
+#ifndef RANGESCHEDULER_H
+#define RANGESCHEDULER_H
+
+#include <QtGlobal>
+#include "executor.h"
+#include <atomic>
+#include <memory>
+
+// Lock-free parallel loop over [0, total). Each worker starts on its own contiguous share of
+// the range and claims fixed-size chunks from it with an atomic cursor; once its share is
+// exhausted it steals chunks from the other workers' cursors. Callers give every worker its
+// own result buffer, indexed by the worker number passed to fn(worker, begin, end), and merge
+// the buffers after run() returns. Workers run on the given lane of the Executor.
+class RangeScheduler
+{
+public:
+    static int workerCount(int total, int chunkSize, Executor::Lane lane = Executor::Interactive)
+    {
+        const int chunks = (total + chunkSize - 1) / chunkSize;
+        return qMax(1, qMin(Executor::instance().threadCount(lane), chunks));
+    }
+
+    template <typename Fn>
+    static void run(int total, int workers, int chunkSize, Fn fn, Executor::Lane lane = Executor::Interactive)
+    {
+        if (workers <= 1) {
+            for (int begin = 0; begin < total; begin += chunkSize) {
+                fn(0, begin, qMin(begin + chunkSize, total));
+            }
+            return;
+        }
+
+        struct alignas(64) Cursor {
+            std::atomic<int> next;
+            int end;
+        };
+
+        std::unique_ptr<Cursor[]> cursors(new Cursor[workers]);
+        const int share = (total + workers - 1) / workers;
+        for (int w = 0; w < workers; ++w) {
+            cursors[w].next.store(qMin(w * share, total), std::memory_order_relaxed);
+            cursors[w].end = qMin((w + 1) * share, total);
+        }
+
+        Executor::instance().parallel(lane, workers, [&cursors, workers, chunkSize, &fn](int worker) {
+            for (int offset = 0; offset < workers; ++offset) {
+                Cursor &cursor = cursors[(worker + offset) % workers];
+                int begin;
+                while ((begin = cursor.next.fetch_add(chunkSize, std::memory_order_relaxed)) < cursor.end) {
+                    fn(worker, begin, qMin(begin + chunkSize, cursor.end));
+                }
+            }
+        });
+    }
+
+    // Calls fn(i) for every i in [0, count), one index per chunk, for coarse items of uneven cost
+    template <typename Fn>
+    static void forEach(int count, Executor::Lane lane, Fn fn)
+    {
+        run(count, workerCount(count, 1, lane), 1, [&fn](int, int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                fn(i);
+            }
+        }, lane);
+    }
+};
+
+#endif // RANGESCHEDULER_H
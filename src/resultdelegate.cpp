@@ -0,0 +1,75 @@
+#include "resultdelegate.h"
+#include <QApplication>
+#include <QPainter>
+#include <QTextLayout>
+
+ResultDelegate::ResultDelegate(QObject *parent)
+    : QStyledItemDelegate(parent)
+{
+}
+
+void ResultDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    const QVector<int> positions = index.data(MatchPositionsRole).value<QVector<int>>();
+    if (positions.isEmpty()) {
+        QStyledItemDelegate::paint(painter, option, index);
+        return;
+    }
+    
+    QStyleOptionViewItem opt = option;
+    initStyleOption(&opt, index);
+    const QWidget *widget = opt.widget;
+    QStyle *style = widget ? widget->style() : QApplication::style();
+    const QRect textRect = style->subElementRect(QStyle::SE_ItemViewItemText, &opt, widget);
+    const QString text = opt.text;
+    
+    // Background, selection, focus frame and icon as usual; the text is laid out below
+    opt.text.clear();
+    style->drawControl(QStyle::CE_ItemViewItem, &opt, painter, widget);
+    
+    const bool selected = opt.state & QStyle::State_Selected;
+    QTextCharFormat matchFormat;
+    matchFormat.setFontWeight(QFont::Bold);
+    if (!selected) {
+        matchFormat.setForeground(opt.palette.brush(QPalette::Link));
+    }
+    
+    // Adjacent positions share one range
+    QVector<QTextLayout::FormatRange> ranges;
+    for (int position : positions) {
+        if (position < 0 || position >= text.size()) {
+            continue;
+        }
+        if (!ranges.isEmpty() && ranges.last().start + ranges.last().length == position) {
+            ++ranges.last().length;
+            continue;
+        }
+        QTextLayout::FormatRange range;
+        range.start = position;
+        range.length = 1;
+        range.format = matchFormat;
+        ranges.append(range);
+    }
+    
+    QTextLayout layout(text, opt.font);
+    QTextOption textOption;
+    textOption.setWrapMode(QTextOption::NoWrap);
+    layout.setTextOption(textOption);
+    layout.setFormats(ranges);
+    layout.beginLayout();
+    QTextLine line = layout.createLine();
+    line.setLineWidth(textRect.width());
+    layout.endLayout();
+    
+    // Same inset the style gives item text
+    const int margin = style->pixelMetric(QStyle::PM_FocusFrameHMargin, nullptr, widget) + 1;
+    const QPalette::ColorGroup group = !(opt.state & QStyle::State_Enabled) ? QPalette::Disabled
+                                     : (opt.state & QStyle::State_Active) ? QPalette::Normal
+                                                                          : QPalette::Inactive;
+    
+    painter->save();
+    painter->setClipRect(textRect);
+    painter->setPen(opt.palette.color(group, selected ? QPalette::HighlightedText : QPalette::Text));
+    layout.draw(painter, QPointF(textRect.left() + margin, textRect.top() + (textRect.height() - line.height()) / 2));
+    painter->restore();
+}
@@ -0,0 +1,23 @@
+#ifndef RESULTDELEGATE_H
+#define RESULTDELEGATE_H
+
+#include <QStyledItemDelegate>
+
+// Paints a result's text with the characters the query matched in bold. The positions are
+// read from MatchPositionsRole, which MainWindow fills only for the rows of the shown page;
+// rows without positions are painted the usual way.
+class ResultDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    enum Roles {
+        MatchPositionsRole = Qt::UserRole + 1  // QVector<int> of ascending indices into the text
+    };
+
+    explicit ResultDelegate(QObject *parent = nullptr);
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+};
+
+#endif // RESULTDELEGATE_H
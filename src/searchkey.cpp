@@ -0,0 +1,106 @@
+#include "searchkey.h"
+
+static void appendUtf8(QByteArray &out, uint c)
+{
+    if (c < 0x80) {
+        out.append(char(c));
+    } else if (c < 0x800) {
+        out.append(char(0xc0 | (c >> 6)));
+        out.append(char(0x80 | (c & 0x3f)));
+    } else if (c < 0x10000) {
+        out.append(char(0xe0 | (c >> 12)));
+        out.append(char(0x80 | ((c >> 6) & 0x3f)));
+        out.append(char(0x80 | (c & 0x3f)));
+    } else {
+        out.append(char(0xf0 | (c >> 18)));
+        out.append(char(0x80 | ((c >> 12) & 0x3f)));
+        out.append(char(0x80 | ((c >> 6) & 0x3f)));
+        out.append(char(0x80 | (c & 0x3f)));
+    }
+}
+
+// Letters that keep their stroke or shape under NFKD but are searched as plain Latin letters
+static const char *strippedLetter(uint c)
+{
+    switch (c) {
+    case 0x00df:  // ß
+    case 0x1e9e:  // ẞ, should case folding leave it
+        return "ss";
+    case 0x00e6:  // æ
+        return "ae";
+    case 0x0153:  // œ
+        return "oe";
+    case 0x00f8:  // ø
+        return "o";
+    case 0x0111:  // đ
+        return "d";
+    case 0x0142:  // ł
+        return "l";
+    case 0x0131:  // ı
+        return "i";
+    default:
+        return nullptr;
+    }
+}
+
+static void appendFolded(QByteArray &out, uint c)
+{
+    c = QChar::toCaseFolded(c);
+    if (QChar::category(c) == QChar::Mark_NonSpacing) {
+        return;
+    }
+    
+    const char *letters = strippedLetter(c);
+    if (letters) {
+        out.append(letters);
+    } else {
+        appendUtf8(out, c);
+    }
+}
+
+QString SearchKey::fold(const QString &text)
+{
+    return QString::fromUtf8(foldToUtf8(text));
+}
+
+QByteArray SearchKey::foldToUtf8(const QString &text, int from, QVarLengthArray<int, 256> *charAt)
+{
+    QByteArray key;
+    key.reserve(text.size() - from);
+    if (charAt) {
+        charAt->clear();
+    }
+    
+    for (int i = from; i < text.size();) {
+        const int begin = key.size();
+        const ushort unit = text.at(i).unicode();
+        int units = 1;
+        
+        if (unit < 0x80) {
+            key.append(char(unit >= 'A' && unit <= 'Z' ? unit + ('a' - 'A') : unit));
+        } else {
+            if (QChar::isHighSurrogate(unit) && i + 1 < text.size() && text.at(i + 1).isLowSurrogate()) {
+                units = 2;
+            }
+            
+            // Decomposes to the base letter followed by its marks, which appendFolded() drops
+            const QString decomposed = text.mid(i, units).normalized(QString::NormalizationForm_KD);
+            for (int k = 0; k < decomposed.size(); ++k) {
+                uint part = decomposed.at(k).unicode();
+                if (QChar::isHighSurrogate(part) && k + 1 < decomposed.size()) {
+                    part = QChar::surrogateToUcs4(decomposed.at(k), decomposed.at(k + 1));
+                    ++k;
+                }
+                appendFolded(key, part);
+            }
+        }
+        
+        if (charAt) {
+            for (int b = begin; b < key.size(); ++b) {
+                charAt->append(i);
+            }
+        }
+        i += units;
+    }
+    return key;
+}
@@ -0,0 +1,28 @@
+#ifndef SEARCHKEY_H
+#define SEARCHKEY_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVarLengthArray>
+
+// The form names, paths and queries are compared in: compatibility decomposition (NFKD)
+// with nonspacing marks dropped, then simple case folding (QChar::toCaseFolded, one
+// character to one), plus a few letters that have no decomposition but are commonly typed
+// without their stroke ("ß" as "ss", "ø" as "o", the Turkish dotless "ı" as "i").
+// "Résumé.pdf" and "RESUME.PDF" both become "resume.pdf". Full case folding's one-to-many
+// mappings are not applied beyond that list; most of them are covered by the decomposition.
+//
+// Every character is folded on its own, so the key can be mapped back to the original text.
+// Entries are folded once, when they are indexed; at search time only the query is folded,
+// and highlighting folds the rows it shows.
+class SearchKey
+{
+public:
+    static QString fold(const QString &text);
+    
+    // Folds text from index from onwards into UTF-8. If charAt is given it receives, for every
+    // byte of the key, the index in text of the character the byte came from.
+    static QByteArray foldToUtf8(const QString &text, int from = 0, QVarLengthArray<int, 256> *charAt = nullptr);
+};
+
+#endif // SEARCHKEY_H
@@ -0,0 +1,40 @@
+#include "topkselector.h"
+#include <algorithm>
+
+TopKSelector::TopKSelector(int capacity)
+    : m_capacity(qMax(0, capacity))
+{
+}
+
+void TopKSelector::push(int entry, int score)
+{
+    const ScoredEntry candidate(entry, score);
+
+    if (m_heap.size() < m_capacity) {
+        m_heap.append(candidate);
+        std::push_heap(m_heap.begin(), m_heap.end(), ranksBefore);
+        return;
+    }
+
+    if (m_capacity == 0 || !ranksBefore(candidate, m_heap.first())) {
+        return;
+    }
+
+    std::pop_heap(m_heap.begin(), m_heap.end(), ranksBefore);
+    m_heap.last() = candidate;
+    std::push_heap(m_heap.begin(), m_heap.end(), ranksBefore);
+}
+
+void TopKSelector::merge(const TopKSelector &other)
+{
+    for (const ScoredEntry &scored : other.m_heap) {
+        push(scored.first, scored.second);
+    }
+}
+
+QVector<TopKSelector::ScoredEntry> TopKSelector::sorted() const
+{
+    QVector<ScoredEntry> result = m_heap;
+    std::sort(result.begin(), result.end(), ranksBefore);
+    return result;
+}
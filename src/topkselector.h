@@ -0,0 +1,38 @@
+#ifndef TOPKSELECTOR_H
+#define TOPKSELECTOR_H
+
+#include <QVector>
+#include <QPair>
+
+// Bounded selection of the best (entry index, score) pairs. The worst kept pair sits on top of
+// a heap, so each candidate costs O(log k) and only k pairs are ever held. Higher scores rank
+// first; equal scores rank by lower entry index so results are deterministic.
+class TopKSelector
+{
+public:
+    typedef QPair<int, int> ScoredEntry;
+
+    explicit TopKSelector(int capacity = 0);
+
+    int capacity() const { return m_capacity; }
+    int size() const { return m_heap.size(); }
+    bool isEmpty() const { return m_heap.isEmpty(); }
+
+    void push(int entry, int score);
+    void merge(const TopKSelector &other);
+    void clear() { m_heap.clear(); }
+
+    // Kept pairs, best first
+    QVector<ScoredEntry> sorted() const;
+
+    static bool ranksBefore(const ScoredEntry &a, const ScoredEntry &b)
+    {
+        return a.second > b.second || (a.second == b.second && a.first < b.first);
+    }
+
+private:
+    int m_capacity;
+    QVector<ScoredEntry> m_heap;
+};
+
+#endif // TOPKSELECTOR_H
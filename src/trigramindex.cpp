@@ -0,0 +1,178 @@
+#include "trigramindex.h"
+#include "entrystore.h"
+#include "rangescheduler.h"
+#include <QPair>
+#include <algorithm>
+
+static void appendVarint(QByteArray &data, quint32 value)
+{
+    while (value >= 0x80) {
+        data.append(char(value | 0x80));
+        value >>= 7;
+    }
+    data.append(char(value));
+}
+
+static quint32 readVarint(const char *&cursor)
+{
+    quint32 value = 0;
+    int shift = 0;
+    uchar byte;
+    do {
+        byte = uchar(*cursor++);
+        value |= quint32(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return value;
+}
+
+TrigramIndex::TrigramIndex()
+{
+}
+
+static const int BUILD_CHUNK_SIZE = 16384;
+
+void TrigramIndex::build(const EntryStore &entries)
+{
+    clear();
+
+    // Index slot ranges independently, then splice their lists together in slot order
+    QVector<QPair<int, int>> ranges;
+    for (int begin = 0; begin < entries.size(); begin += BUILD_CHUNK_SIZE) {
+        ranges.append(qMakePair(begin, qMin(entries.size(), begin + BUILD_CHUNK_SIZE)));
+    }
+
+    QVector<TrigramIndex> partials(ranges.size());
+    TrigramIndex *partialData = partials.data();
+    RangeScheduler::forEach(ranges.size(), Executor::Background, [&entries, &ranges, partialData](int r) {
+        const QPair<int, int> &range = ranges.at(r);
+        TrigramIndex &partial = partialData[r];
+        for (int slot = range.first; slot < range.second; ++slot) {
+            if (!entries.isRemoved(slot)) {
+                partial.add(slot, entries.lowerName(slot), entries.lowerNameLength(slot));
+            }
+        }
+    });
+
+    for (const TrigramIndex &partial : partials) {
+        for (auto it = partial.m_listOfTrigram.constBegin(); it != partial.m_listOfTrigram.constEnd(); ++it) {
+            auto target = m_listOfTrigram.find(it.key());
+            if (target == m_listOfTrigram.end()) {
+                target = m_listOfTrigram.insert(it.key(), m_lists.size());
+                m_lists.append(PostingList{QByteArray(), 0, -1});
+            }
+            appendList(m_lists[target.value()], partial.m_lists.at(it.value()));
+        }
+    }
+
+    for (PostingList &list : m_lists) {
+        list.data.squeeze();
+    }
+}
+
+void TrigramIndex::appendList(PostingList &into, const PostingList &from)
+{
+    // Only the first delta depends on where the list starts; the rest is copied as is
+    const char *cursor = from.data.constData();
+    const int first = int(readVarint(cursor)) - 1;
+    const int headerSize = cursor - from.data.constData();
+
+    appendVarint(into.data, quint32(first - into.last));
+    into.data.append(from.data.constData() + headerSize, from.data.size() - headerSize);
+    into.count += from.count;
+    into.last = from.last;
+}
+
+void TrigramIndex::add(int slot, const char *name, int length)
+{
+    for (int i = 0; i + 3 <= length; ++i) {
+        const quint32 trigram = trigramAt(name + i);
+
+        auto it = m_listOfTrigram.find(trigram);
+        if (it == m_listOfTrigram.end()) {
+            it = m_listOfTrigram.insert(trigram, m_lists.size());
+            m_lists.append(PostingList{QByteArray(), 0, -1});
+        }
+
+        // Slots arrive in ascending order; a repeated trigram in the same name is listed once
+        PostingList &list = m_lists[it.value()];
+        if (list.last == slot) {
+            continue;
+        }
+        appendVarint(list.data, quint32(slot - list.last));
+        list.last = slot;
+        ++list.count;
+    }
+}
+
+void TrigramIndex::clear()
+{
+    m_listOfTrigram.clear();
+    m_lists.clear();
+}
+
+qint64 TrigramIndex::byteSize() const
+{
+    qint64 total = 0;
+    for (const PostingList &list : m_lists) {
+        total += list.data.size();
+    }
+    return total;
+}
+
+bool TrigramIndex::candidates(const char *query, int length, QVector<int> &result) const
+{
+    result.clear();
+    if (length < 3) {
+        return false;
+    }
+
+    QVector<const PostingList *> lists;
+    for (int i = 0; i + 3 <= length; ++i) {
+        const auto it = m_listOfTrigram.constFind(trigramAt(query + i));
+        if (it == m_listOfTrigram.constEnd()) {
+            return true;
+        }
+        const PostingList *list = &m_lists.at(it.value());
+        if (!lists.contains(list)) {
+            lists.append(list);
+        }
+    }
+
+    // Start from the rarest trigram so every later pass filters the smallest set
+    std::sort(lists.begin(), lists.end(), [](const PostingList *a, const PostingList *b) {
+        return a->count < b->count;
+    });
+
+    const PostingList *rarest = lists.first();
+    result.reserve(rarest->count);
+    const char *cursor = rarest->data.constData();
+    int slot = -1;
+    for (int n = 0; n < rarest->count; ++n) {
+        slot += readVarint(cursor);
+        result.append(slot);
+    }
+
+    for (int l = 1; l < lists.size() && !result.isEmpty(); ++l) {
+        const PostingList *list = lists.at(l);
+        const char *listCursor = list->data.constData();
+        int listSlot = -1;
+        int remaining = list->count;
+        int kept = 0;
+
+        for (int i = 0; i < result.size(); ++i) {
+            const int wanted = result.at(i);
+            while (listSlot < wanted && remaining > 0) {
+                listSlot += readVarint(listCursor);
+                --remaining;
+            }
+            if (listSlot == wanted) {
+                result[kept++] = wanted;
+            } else if (listSlot < wanted) {
+                break;  // List exhausted
+            }
+        }
+        result.resize(kept);
+    }
+    return true;
+}
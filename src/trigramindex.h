@@ -0,0 +1,49 @@
+#ifndef TRIGRAMINDEX_H
+#define TRIGRAMINDEX_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+#include <QtGlobal>
+
+class EntryStore;
+
+// Inverted index from each three-byte sequence of a lowercased file name to the entries that
+// contain it. Posting lists hold ascending entry slots as varint-encoded deltas, so appending
+// a new entry is O(1) per trigram and a typical list costs one or two bytes per entry.
+// Intersecting the lists of a query's trigrams yields every name that may contain the query
+// as a substring; callers still verify each candidate.
+class TrigramIndex
+{
+public:
+    TrigramIndex();
+
+    void build(const EntryStore &entries);
+    void add(int slot, const char *name, int length);
+    void clear();
+
+    // False when the query is too short to have a trigram; otherwise fills ascending slots
+    bool candidates(const char *query, int length, QVector<int> &result) const;
+
+    int listCount() const { return m_lists.size(); }
+    qint64 byteSize() const;
+
+private:
+    struct PostingList {
+        QByteArray data;
+        int count;
+        int last;
+    };
+
+    static void appendList(PostingList &into, const PostingList &from);
+
+    static quint32 trigramAt(const char *s)
+    {
+        return quint32(uchar(s[0])) | quint32(uchar(s[1])) << 8 | quint32(uchar(s[2])) << 16;
+    }
+
+    QHash<quint32, int> m_listOfTrigram;
+    QVector<PostingList> m_lists;
+};
+
+#endif // TRIGRAMINDEX_H
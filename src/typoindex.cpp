@@ -0,0 +1,299 @@
+#include "typoindex.h"
+#include "editdistance.h"
+#include "entrystore.h"
+#include "rangescheduler.h"
+#include <QPair>
+#include <QVarLengthArray>
+#include <algorithm>
+#include <cstring>
+
+static const int BUILD_CHUNK_SIZE = 16384;
+static const int DELETION_CHUNK_SIZE = 4096;
+static const size_t MIN_PENDING_MERGE = 4096;
+
+static bool isWordByte(uchar c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9');
+}
+
+static bool isHumpStart(const char *original, int i)
+{
+    return i > 0 && original[i] >= 'A' && original[i] <= 'Z' && original[i - 1] >= 'a' && original[i - 1] <= 'z';
+}
+
+// FNV-1a over the word with the byte at skip left out; skip -1 hashes the whole word
+static uint deletionHash(const char *word, int length, int skip)
+{
+    uint hash = 2166136261u;
+    for (int i = 0; i < length; ++i) {
+        if (i != skip) {
+            hash = (hash ^ uchar(word[i])) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+// Calls fn with the hash of the word and of each distinct single-byte deletion
+template <typename Fn>
+static void forEachDeletion(const char *word, int length, Fn fn)
+{
+    fn(deletionHash(word, length, -1));
+    for (int skip = 0; skip < length; ++skip) {
+        // Dropping either byte of a doubled letter leaves the same variant
+        if (skip == 0 || word[skip] != word[skip - 1]) {
+            fn(deletionHash(word, length, skip));
+        }
+    }
+}
+
+// Edit distance counts a swap of neighbours as two edits; the typo tier counts it as one
+static bool isNeighbourSwap(const char *a, const char *b, int length)
+{
+    int prefix = 0;
+    while (prefix < length && a[prefix] == b[prefix]) {
+        ++prefix;
+    }
+    return prefix + 1 < length && a[prefix] == b[prefix + 1] && a[prefix + 1] == b[prefix] &&
+           memcmp(a + prefix + 2, b + prefix + 2, length - prefix - 2) == 0;
+}
+
+// Two 16-bit LSD radix passes over the hashes; several times faster than std::sort on the
+// millions of variants a large tree has
+template <typename T>
+static void sortByHash(std::vector<T> &items)
+{
+    std::vector<T> scratch(items.size());
+    std::vector<size_t> counts(65536);
+    for (int shift = 0; shift < 32; shift += 16) {
+        std::fill(counts.begin(), counts.end(), 0);
+        for (const T &item : items) {
+            ++counts[(item.hash >> shift) & 0xffff];
+        }
+        size_t position = 0;
+        for (size_t &count : counts) {
+            const size_t bucket = count;
+            count = position;
+            position += bucket;
+        }
+        for (const T &item : items) {
+            scratch[counts[(item.hash >> shift) & 0xffff]++] = item;
+        }
+        items.swap(scratch);
+    }
+}
+
+TypoIndex::TypoIndex()
+    : m_sortedDeletions(0)
+{
+    m_wordOffsets.append(0);
+}
+
+void TypoIndex::build(const EntryStore &entries)
+{
+    clear();
+
+    // Collect the words of slot ranges independently, then splice them together in slot order
+    QVector<QPair<int, int>> ranges;
+    for (int begin = 0; begin < entries.size(); begin += BUILD_CHUNK_SIZE) {
+        ranges.append(qMakePair(begin, qMin(entries.size(), begin + BUILD_CHUNK_SIZE)));
+    }
+
+    QVector<TypoIndex> partials(ranges.size());
+    TypoIndex *partialData = partials.data();
+    RangeScheduler::forEach(ranges.size(), Executor::Background, [&entries, &ranges, partialData](int r) {
+        const QPair<int, int> &range = ranges.at(r);
+        for (int slot = range.first; slot < range.second; ++slot) {
+            if (!entries.isRemoved(slot)) {
+                const char *original = (entries.flags(slot) & EntryStore::AsciiFlag) ? entries.name(slot) : nullptr;
+                partialData[r].addWords(slot, entries.lowerName(slot), original, entries.lowerNameLength(slot), nullptr);
+            }
+        }
+    });
+
+    for (const TypoIndex &partial : partials) {
+        for (int w = 0; w < partial.wordCount(); ++w) {
+            bool added;
+            const int word = internWord(partial.word(w), partial.wordLength(w), &added);
+            m_postings[word] += partial.m_postings.at(w);
+        }
+    }
+
+    // Every word's variants are independent, so they are hashed in parallel and sorted once
+    const int chunks = (wordCount() + DELETION_CHUNK_SIZE - 1) / DELETION_CHUNK_SIZE;
+    std::vector<std::vector<Deletion>> chunkDeletions(chunks);
+    RangeScheduler::forEach(chunks, Executor::Background, [this, &chunkDeletions](int c) {
+        const int end = qMin(wordCount(), (c + 1) * DELETION_CHUNK_SIZE);
+        for (int word = c * DELETION_CHUNK_SIZE; word < end; ++word) {
+            appendDeletions(word, chunkDeletions[c]);
+        }
+    });
+
+    size_t total = 0;
+    for (const std::vector<Deletion> &chunk : chunkDeletions) {
+        total += chunk.size();
+    }
+    m_deletions.reserve(total);
+    for (const std::vector<Deletion> &chunk : chunkDeletions) {
+        m_deletions.insert(m_deletions.end(), chunk.begin(), chunk.end());
+    }
+    sortByHash(m_deletions);
+    m_sortedDeletions = m_deletions.size();
+}
+
+void TypoIndex::add(int slot, const char *name, const char *original, int length)
+{
+    QVector<int> newWords;
+    addWords(slot, name, original, length, &newWords);
+    if (newWords.isEmpty()) {
+        return;
+    }
+
+    for (int word : newWords) {
+        appendDeletions(word, m_deletions);
+    }
+
+    // Lookups scan the pending variants linearly, so they are merged in once that gets slow
+    const size_t pending = m_deletions.size() - m_sortedDeletions;
+    if (pending >= qMax(MIN_PENDING_MERGE, m_sortedDeletions / 8)) {
+        mergePendingDeletions();
+    }
+}
+
+void TypoIndex::clear()
+{
+    m_wordIds.clear();
+    m_wordArena.clear();
+    m_wordOffsets.clear();
+    m_wordOffsets.append(0);
+    m_postings.clear();
+    m_deletions.clear();
+    m_sortedDeletions = 0;
+}
+
+void TypoIndex::addWords(int slot, const char *name, const char *original, int length, QVector<int> *newWords)
+{
+    int start = -1;
+    for (int i = 0; i <= length; ++i) {
+        // A word ends at any other byte and where a camelCase hump begins
+        const bool wordByte = i < length && isWordByte(name[i]);
+        if (start >= 0 && (!wordByte || (original && isHumpStart(original, i)))) {
+            addWord(slot, name + start, i - start, newWords);
+            start = -1;
+        }
+        if (wordByte && start < 0) {
+            start = i;
+        }
+    }
+}
+
+void TypoIndex::addWord(int slot, const char *text, int length, QVector<int> *newWords)
+{
+    if (length < MIN_WORD_LENGTH || length > MAX_WORD_LENGTH) {
+        return;
+    }
+
+    bool added;
+    const int word = internWord(text, length, &added);
+    if (added && newWords) {
+        newWords->append(word);
+    }
+
+    // Slots arrive in ascending order; a word repeated in one name is listed once
+    QVector<int> &posting = m_postings[word];
+    if (posting.isEmpty() || posting.last() != slot) {
+        posting.append(slot);
+    }
+}
+
+int TypoIndex::internWord(const char *word, int length, bool *added)
+{
+    const auto it = m_wordIds.constFind(QByteArray::fromRawData(word, length));
+    *added = it == m_wordIds.constEnd();
+    if (!*added) {
+        return it.value();
+    }
+
+    const int id = m_postings.size();
+    m_wordIds.insert(QByteArray(word, length), id);
+    m_wordArena.append(word, length);
+    m_wordOffsets.append(m_wordArena.size());
+    m_postings.append(QVector<int>());
+    return id;
+}
+
+void TypoIndex::appendDeletions(int word, std::vector<Deletion> &into) const
+{
+    forEachDeletion(this->word(word), wordLength(word), [word, &into](uint hash) {
+        into.push_back(Deletion{hash, word});
+    });
+}
+
+void TypoIndex::mergePendingDeletions()
+{
+    const auto byHash = [](const Deletion &a, const Deletion &b) { return a.hash < b.hash; };
+    std::sort(m_deletions.begin() + m_sortedDeletions, m_deletions.end(), byHash);
+    std::inplace_merge(m_deletions.begin(), m_deletions.begin() + m_sortedDeletions, m_deletions.end(), byHash);
+    m_sortedDeletions = m_deletions.size();
+}
+
+void TypoIndex::lookup(const char *query, int length, QVector<Match> &result) const
+{
+    result.clear();
+    if (length < MIN_WORD_LENGTH || length > MAX_WORD_LENGTH) {
+        return;
+    }
+    for (int i = 0; i < length; ++i) {
+        if (!isWordByte(query[i])) {
+            return;
+        }
+    }
+
+    // Sharing a deletion variant is necessary but not sufficient, so candidates are confirmed
+    // with the bit-parallel kernel, encoded once for the whole lookup
+    const BitParallelEditDistance distance(QByteArray::fromRawData(query, length));
+    QVarLengthArray<int, 64> checked;
+    QVarLengthArray<int, 64> words;
+    const auto consider = [&](int word) {
+        if (std::find(checked.begin(), checked.end(), word) != checked.end()) {
+            return;
+        }
+        checked.append(word);
+
+        const char *text = this->word(word);
+        const int textLength = wordLength(word);
+        const bool oneTypo = distance.distance(text, textLength, 1) == 1 ||
+                             (textLength == length && isNeighbourSwap(query, text, length));
+        if (oneTypo &&
+            std::search(text, text + textLength, query, query + length) == text + textLength) {
+            words.append(word);
+        }
+    };
+
+    const Deletion *sorted = m_deletions.data();
+    forEachDeletion(query, length, [&](uint hash) {
+        const Deletion *first = std::lower_bound(sorted, sorted + m_sortedDeletions, hash,
+                                                 [](const Deletion &d, uint h) { return d.hash < h; });
+        for (const Deletion *d = first; d != sorted + m_sortedDeletions && d->hash == hash; ++d) {
+            consider(d->word);
+        }
+        for (size_t i = m_sortedDeletions; i < m_deletions.size(); ++i) {
+            if (m_deletions[i].hash == hash) {
+                consider(m_deletions[i].word);
+            }
+        }
+    });
+
+    for (int word : words) {
+        for (int slot : m_postings.at(word)) {
+            result.append(Match{slot, wordLength(word)});
+        }
+    }
+
+    // One match per entry, for its longest misspelled word
+    std::sort(result.begin(), result.end(), [](const Match &a, const Match &b) {
+        return a.slot != b.slot ? a.slot < b.slot : a.wordLength > b.wordLength;
+    });
+    result.erase(std::unique(result.begin(), result.end(), [](const Match &a, const Match &b) {
+        return a.slot == b.slot;
+    }), result.end());
+}
@@ -0,0 +1,69 @@
+#ifndef TYPOINDEX_H
+#define TYPOINDEX_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+#include <QtGlobal>
+#include <vector>
+
+class EntryStore;
+
+// Symmetric-deletion index (as in SymSpell) over the distinct words of the lowercased file
+// names, a word being a run of ASCII letters and digits; in ASCII names camelCase humps start
+// words too. Each word is kept once with the ascending slots of the entries whose name holds
+// it, and the word and every variant of it with one character deleted are hashed to it. Two
+// strings one typo apart (a character inserted, dropped or replaced, or two neighbours
+// swapped) always share such a variant, so a query finds its misspelled words with
+// length + 1 probes, however many entries there are.
+class TypoIndex
+{
+public:
+    struct Match {
+        int slot;
+        int wordLength;  // Longest of the entry's words the query is one typo from
+    };
+
+    static const int MIN_WORD_LENGTH = 3;
+    static const int MAX_WORD_LENGTH = 32;
+
+    TypoIndex();
+
+    void build(const EntryStore &entries);
+    // original is the name as spelled, to find camelCase humps in, or null if it is not ASCII
+    void add(int slot, const char *name, const char *original, int length);
+    void clear();
+
+    // Entries with a word exactly one typo from the query, ascending and each listed once.
+    // Words that contain the query are left out; the substring tiers already rank those.
+    // Removed entries are not filtered out.
+    void lookup(const char *query, int length, QVector<Match> &result) const;
+
+    int wordCount() const { return m_postings.size(); }
+
+private:
+    struct Deletion {
+        uint hash;
+        int word;
+    };
+
+    void addWords(int slot, const char *name, const char *original, int length, QVector<int> *newWords);
+    void addWord(int slot, const char *text, int length, QVector<int> *newWords);
+    int internWord(const char *word, int length, bool *added);
+    void appendDeletions(int word, std::vector<Deletion> &into) const;
+    void mergePendingDeletions();
+    const char *word(int word) const { return m_wordArena.constData() + m_wordOffsets.at(word); }
+    int wordLength(int word) const { return m_wordOffsets.at(word + 1) - m_wordOffsets.at(word); }
+
+    QHash<QByteArray, int> m_wordIds;
+    QByteArray m_wordArena;
+    QVector<quint32> m_wordOffsets;
+    QVector<QVector<int>> m_postings;
+
+    // Sorted by hash up to m_sortedDeletions; variants of words added since build() follow
+    // unsorted until there are enough of them to merge in
+    std::vector<Deletion> m_deletions;
+    size_t m_sortedDeletions;
+};
+
+#endif // TYPOINDEX_H